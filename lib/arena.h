@@ -0,0 +1,40 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifndef ARENA_H
+#define ARENA_H 1
+
+#include <glib.h>
+
+
+/* the size of the chunks if none is given */
+#define DICT_ARENA_CHUNK_SIZE	4096
+
+
+typedef struct _DictArena DictArena;
+
+
+DictArena *dict_arena_new(gsize chunk_size);
+gpointer dict_arena_alloc(DictArena *arena, gsize size);
+gchar *dict_arena_strndup(DictArena *arena, const gchar *str, gsize len);
+gchar *dict_arena_strdup(DictArena *arena, const gchar *str);
+void dict_arena_free(DictArena *arena);
+
+
+#endif
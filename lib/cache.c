@@ -0,0 +1,184 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+/* A cache of the definitions of recently looked up words, shared by all lookups of the
+ * process, e.g. the main window, the scan popup and D-Bus callers. Only found definitions
+ * are kept, the least recently used words are dropped first. The functions may be called
+ * from any thread. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "dictparser.h"
+#include "cache.h"
+
+
+/* servers rarely change their databases, but don't keep definitions forever */
+#define DICT_CACHE_MAX_AGE		((gint64) 60 * 60 * G_USEC_PER_SEC)
+
+
+typedef struct
+{
+	gchar *key;
+	GPtrArray *definitions;	/* DictDefinition items */
+	gint64 added;
+	GList link;				/* the entry's node in 'lru' */
+} CacheEntry;
+
+
+/* key -> CacheEntry */
+static GHashTable *entries = NULL;
+/* the most recently used entries first */
+static GQueue lru = G_QUEUE_INIT;
+G_LOCK_DEFINE_STATIC(cache);
+
+
+/* Lookups are case-insensitive like the ones of most servers */
+static gchar *cache_key(const gchar *server, gint port, const gchar *database,
+						const gchar *word)
+{
+	gchar *folded = g_utf8_casefold(word, -1);
+	gchar *key = g_strdup_printf("%s:%d/%s/%s", server, port, database, folded);
+
+	g_free(folded);
+	return key;
+}
+
+
+static GPtrArray *copy_definitions(GPtrArray *definitions)
+{
+	GPtrArray *copy;
+	guint i;
+
+	copy = g_ptr_array_new_full(definitions->len, (GDestroyNotify) dict_definition_free);
+	for (i = 0; i < definitions->len; i++)
+		g_ptr_array_add(copy, dict_definition_copy(g_ptr_array_index(definitions, i)));
+
+	return copy;
+}
+
+
+/* Has to be called with the lock held */
+static void cache_remove(CacheEntry *entry)
+{
+	g_queue_unlink(&lru, &entry->link);
+	g_hash_table_remove(entries, entry->key);
+
+	g_ptr_array_free(entry->definitions, TRUE);
+	g_free(entry->key);
+	g_free(entry);
+}
+
+
+/* Has to be called with the lock held, returns NULL for expired entries */
+static CacheEntry *cache_get(const gchar *key)
+{
+	CacheEntry *entry;
+
+	if (entries == NULL || (entry = g_hash_table_lookup(entries, key)) == NULL)
+		return NULL;
+
+	if (g_get_monotonic_time() - entry->added > DICT_CACHE_MAX_AGE)
+	{
+		cache_remove(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+
+/* Returns a copy of the cached definitions of the word, which has to be freed with
+ * g_ptr_array_free(), or NULL if the word is not cached */
+GPtrArray *dict_cache_lookup(const gchar *server, gint port, const gchar *database,
+							 const gchar *word)
+{
+	CacheEntry *entry;
+	GPtrArray *definitions = NULL;
+	gchar *key = cache_key(server, port, database, word);
+
+	G_LOCK(cache);
+	if ((entry = cache_get(key)) != NULL)
+	{
+		g_queue_unlink(&lru, &entry->link);
+		g_queue_push_head_link(&lru, &entry->link);
+		definitions = copy_definitions(entry->definitions);
+	}
+	G_UNLOCK(cache);
+	g_free(key);
+
+	return definitions;
+}
+
+
+/* Like dict_cache_lookup() but without copying the definitions and without counting
+ * as use of the word */
+gboolean dict_cache_contains(const gchar *server, gint port, const gchar *database,
+							 const gchar *word)
+{
+	gboolean found;
+	gchar *key = cache_key(server, port, database, word);
+
+	G_LOCK(cache);
+	found = (cache_get(key) != NULL);
+	G_UNLOCK(cache);
+	g_free(key);
+
+	return found;
+}
+
+
+/* Stores a copy of the definitions found for the word */
+void dict_cache_insert(const gchar *server, gint port, const gchar *database,
+					   const gchar *word, GPtrArray *definitions)
+{
+	CacheEntry *entry;
+
+	if (definitions == NULL || definitions->len == 0)
+		return;
+
+	entry = g_new0(CacheEntry, 1);
+	entry->key = cache_key(server, port, database, word);
+	entry->definitions = copy_definitions(definitions);
+	entry->added = g_get_monotonic_time();
+	entry->link.data = entry;
+
+	G_LOCK(cache);
+	if (entries == NULL)
+		entries = g_hash_table_new(g_str_hash, g_str_equal);
+	else if (g_hash_table_contains(entries, entry->key))
+		cache_remove(g_hash_table_lookup(entries, entry->key));
+
+	g_hash_table_insert(entries, entry->key, entry);
+	g_queue_push_head_link(&lru, &entry->link);
+
+	while (lru.length > DICT_CACHE_MAX_ENTRIES)
+		cache_remove(lru.tail->data);
+	G_UNLOCK(cache);
+}
+
+
+void dict_cache_clear(void)
+{
+	G_LOCK(cache);
+	while (lru.head != NULL)
+		cache_remove(lru.head->data);
+	G_UNLOCK(cache);
+}
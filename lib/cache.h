@@ -0,0 +1,39 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifndef CACHE_H
+#define CACHE_H 1
+
+#include <glib.h>
+
+
+/* the number of looked up words whose definitions are kept */
+#define DICT_CACHE_MAX_ENTRIES	512
+
+
+GPtrArray *dict_cache_lookup(const gchar *server, gint port, const gchar *database,
+							 const gchar *word);
+gboolean dict_cache_contains(const gchar *server, gint port, const gchar *database,
+							 const gchar *word);
+void dict_cache_insert(const gchar *server, gint port, const gchar *database,
+					   const gchar *word, GPtrArray *definitions);
+void dict_cache_clear(void);
+
+
+#endif
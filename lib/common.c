@@ -38,6 +38,12 @@
 #include "spell.h"
 #include "dictd.h"
 #include "gui.h"
+#include "dictparser.h"
+#include "query.h"
+#include "stats.h"
+#include "fuzzy.h"
+#include "history.h"
+#include "scanpopup.h"
 #include "dbus.h"
 
 
@@ -206,6 +212,8 @@ dict_mode_t dict_set_search_mode_from_flags(dict_mode_t mode, gchar flags)
 		mode = DICTMODE_WEB;
 	else if (flags & DICT_FLAGS_MODE_SPELL)
 		mode = DICTMODE_SPELL;
+	else if (flags & DICT_FLAGS_MODE_ALL)
+		mode = DICTMODE_ALL;
 
 	return mode;
 }
@@ -223,6 +231,8 @@ void dict_search_word(DictData *dd, const gchar *word)
 		return;
 	}
 
+	dict_gui_ensure_main_window(dd);
+
 	g_free(dd->searched_word);
 	if (! g_utf8_validate(word, -1, NULL))
 	{	/* try to convert non-UTF8 input otherwise stop the query */
@@ -245,7 +255,7 @@ void dict_search_word(DictData *dd, const gchar *word)
 
 	/* remove leading and trailing spaces */
 	g_strstrip(dd->searched_word);
-	gtk_combo_box_text_prepend_text(GTK_COMBO_BOX_TEXT(dd->main_combo), dd->searched_word);
+	dict_gui_history_add(dd, dd->searched_word);
 
 	dict_gui_clear_text_buffer(dd);
 
@@ -261,6 +271,17 @@ void dict_search_word(DictData *dd, const gchar *word)
 			dict_spell_start_query(dd, dd->searched_word, FALSE);
 			break;
 		}
+		case DICTMODE_ALL:
+		{
+			/* the backends run concurrently and each one fills its own section of the
+			 * results when it is done, so the slowest one determines the total time */
+			dict_gui_sections_create(dd);
+			dict_dictd_start_query(dd, dd->searched_word);
+			dict_dictd_start_local_query(dd, dd->searched_word);
+			if (NZV(dd->spell_bin))
+				dict_spell_start_query(dd, dd->searched_word, FALSE);
+			break;
+		}
 		default:
 		{
 			dict_dictd_start_query(dd, dd->searched_word);
@@ -356,10 +377,15 @@ void dict_read_rc_file(DictData *dd)
 	gint grouping = 1;
 	gboolean mark_paragraphs = FALSE;
 	gboolean show_panel_entry = FALSE;
+	gboolean prebuild_window = FALSE;
+	gboolean scan_selection = FALSE;
+	gboolean server_suggestions = TRUE;
 	gchar *spell_bin_default = get_spell_program();
 	gchar *spell_dictionary_default = get_default_lang();
 	const gchar *server = "dict.org";
 	const gchar *dict = "*";
+	const gchar *strategy = "";
+	const gchar *headword_file = "";
 	const gchar *weburl = NULL;
 	const gchar *spell_bin = NULL;
 	const gchar *spell_dictionary = NULL;
@@ -376,10 +402,15 @@ void dict_read_rc_file(DictData *dd)
 		mode_default = xfce_rc_read_int_entry(rc, "mode_default", mode_default);
 		weburl = xfce_rc_read_entry(rc, "web_url", weburl);
 		show_panel_entry = xfce_rc_read_bool_entry(rc, "show_panel_entry", show_panel_entry);
+		prebuild_window = xfce_rc_read_bool_entry(rc, "prebuild_window", prebuild_window);
+		scan_selection = xfce_rc_read_bool_entry(rc, "scan_selection", scan_selection);
 		panel_entry_size = xfce_rc_read_int_entry(rc, "panel_entry_size", panel_entry_size);
 		port = xfce_rc_read_int_entry(rc, "port", port);
 		server = xfce_rc_read_entry(rc, "server", server);
 		dict = xfce_rc_read_entry(rc, "dict", dict);
+		server_suggestions = xfce_rc_read_bool_entry(rc, "server_suggestions", server_suggestions);
+		strategy = xfce_rc_read_entry(rc, "strategy", strategy);
+		headword_file = xfce_rc_read_entry(rc, "headword_file", headword_file);
 		spell_bin = xfce_rc_read_entry(rc, "spell_bin", spell_bin_default);
 		spell_dictionary = xfce_rc_read_entry(rc, "spell_dictionary", spell_dictionary_default);
 
@@ -408,10 +439,15 @@ void dict_read_rc_file(DictData *dd)
 
 	dd->web_url = g_strdup(weburl);
 	dd->show_panel_entry = show_panel_entry;
+	dd->prebuild_window = prebuild_window;
+	dd->scan_selection = scan_selection;
 	dd->panel_entry_size = panel_entry_size;
 	dd->port = port;
 	dd->server = g_strdup(server);
 	dd->dictionary = g_strdup(dict);
+	dd->server_suggestions = server_suggestions;
+	dd->strategy = g_strdup(strategy);
+	dd->headword_file = g_strdup(headword_file);
 	if (spell_bin != NULL)
 	{
 		dd->spell_bin = g_strdup(spell_bin);
@@ -459,10 +495,15 @@ void dict_write_rc_file(DictData *dd)
 		if (dd->web_url != NULL)
 			xfce_rc_write_entry(rc, "web_url", dd->web_url);
 		xfce_rc_write_bool_entry(rc, "show_panel_entry", dd->show_panel_entry);
+		xfce_rc_write_bool_entry(rc, "prebuild_window", dd->prebuild_window);
+		xfce_rc_write_bool_entry(rc, "scan_selection", dd->scan_selection);
 		xfce_rc_write_int_entry(rc, "panel_entry_size", dd->panel_entry_size);
 		xfce_rc_write_int_entry(rc, "port", dd->port);
 		xfce_rc_write_entry(rc, "server", dd->server);
 		xfce_rc_write_entry(rc, "dict", dd->dictionary);
+		xfce_rc_write_bool_entry(rc, "server_suggestions", dd->server_suggestions);
+		xfce_rc_write_entry(rc, "strategy", dd->strategy);
+		xfce_rc_write_entry(rc, "headword_file", dd->headword_file);
 		xfce_rc_write_entry(rc, "spell_bin", dd->spell_bin);
 		xfce_rc_write_entry(rc, "spell_dictionary", dd->spell_dictionary);
 
@@ -500,11 +541,17 @@ void dict_free_data(DictData *dd)
 	dict_write_rc_file(dd);
 
 	dict_gui_finalize(dd);
+	dict_scan_popup_free(dd);
 
-	gtk_widget_destroy(dd->window);
+	if (dd->window != NULL)
+		gtk_widget_destroy(dd->window);
 
 	g_free(dd->searched_word);
 	g_free(dd->dictionary);
+	g_free(dd->strategy);
+	g_free(dd->headword_file);
+	dict_headwords_free(dd->headwords);
+	dict_history_free(dd->history);
 	g_free(dd->server);
 	g_free(dd->web_url);
 	g_free(dd->spell_bin);
@@ -536,6 +583,7 @@ void dict_drag_data_received(GtkWidget *widget, GdkDragContext *context, gint x,
 DictData *dict_create_dictdata(void)
 {
 	DictData *dd = g_new0(DictData, 1);
+	gchar *history_file;
 
 	/* create a new DictData structure and fill relevant fields with NULL */
 
@@ -544,6 +592,11 @@ DictData *dict_create_dictdata(void)
 	dd->query_status = NO_ERROR;
 	dd->panel_entry = NULL;
 
+	/* the file is read when the history is needed first */
+	history_file = xfce_resource_save_location(XFCE_RESOURCE_CACHE, "xfce4/xfce4-dict/history", FALSE);
+	dd->history = dict_history_new(history_file);
+	g_free(history_file);
+
 	return dd;
 }
 
@@ -600,30 +653,180 @@ gchar *dict_get_clipboard_contents(void)
 static gboolean on_handle_search(Dict *skeleton, GDBusMethodInvocation *invocation,
 	const gchar *arg_phrase, gpointer user_data)
 {
-	dict_search_word((DictData *) user_data, arg_phrase);
+	DictData *dd = user_data;
+
+	if (dd->is_daemon)
+	{	/* there is no window to show the results in */
+		g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR,
+			G_DBUS_ERROR_NOT_SUPPORTED, "Search is not supported in daemon mode");
+		return TRUE;
+	}
+
+	dict_search_word(dd, arg_phrase);
 	dict_complete_search(skeleton, invocation);
 	return TRUE;
 }
 
 
-static void on_name_acquired(GDBusConnection *connection, const gchar *name,
+static GVariant *query_get_results(DictQuery *query)
+{
+	GVariantBuilder builder;
+	guint i;
+
+	switch (query->type)
+	{
+		case DICT_QUERY_DEFINE:
+		{
+			DictDefinition *def;
+
+			g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sss)"));
+			for (i = 0; i < query->results->len; i++)
+			{
+				def = g_ptr_array_index(query->results, i);
+				g_variant_builder_add(&builder, "(sss)", def->word, def->database, def->definition);
+			}
+			break;
+		}
+		case DICT_QUERY_MATCH:
+		{
+			DictMatch *match;
+
+			g_variant_builder_init(&builder, G_VARIANT_TYPE("a(ss)"));
+			for (i = 0; i < query->results->len; i++)
+			{
+				match = g_ptr_array_index(query->results, i);
+				g_variant_builder_add(&builder, "(ss)", match->database, match->word);
+			}
+			break;
+		}
+		case DICT_QUERY_SPELL:
+		default:
+		{
+			DictSpellResult *result;
+
+			g_variant_builder_init(&builder, G_VARIANT_TYPE("a(sas)"));
+			for (i = 0; i < query->results->len; i++)
+			{
+				result = g_ptr_array_index(query->results, i);
+				g_variant_builder_add(&builder, "(s^as)", result->word, result->suggestions);
+			}
+			break;
+		}
+	}
+	return g_variant_builder_end(&builder);
+}
+
+
+/* Sends the results of a query back to the D-Bus caller */
+static void query_finished_cb(DictQuery *query, gpointer user_data)
+{
+	GDBusMethodInvocation *invocation = user_data;
+	GVariant *results;
+
+	if (query->error_message != NULL)
+	{
+		g_dbus_method_invocation_return_error_literal(invocation, G_IO_ERROR,
+			G_IO_ERROR_FAILED, query->error_message);
+		return;
+	}
+	results = query_get_results(query);
+	g_dbus_method_invocation_return_value(invocation, g_variant_new_tuple(&results, 1));
+}
+
+
+/* The queries block on the network and on the spell checker, so they run in a worker
+ * thread and the method call is answered when they are done */
+static gboolean on_handle_define(Dict *skeleton, GDBusMethodInvocation *invocation,
+	const gchar * const *arg_words, const gchar *arg_database, gpointer user_data)
+{
+	DictData *dd = user_data;
+	DictQuery *query = dict_query_new(DICT_QUERY_DEFINE, dd->server, dd->port,
+		NZV(arg_database) ? arg_database : dd->dictionary, NULL, arg_words);
+
+	dict_query_run_async(query, query_finished_cb, invocation);
+	return TRUE;
+}
+
+
+static gboolean on_handle_spell(Dict *skeleton, GDBusMethodInvocation *invocation,
+	const gchar * const *arg_words, gpointer user_data)
+{
+	DictData *dd = user_data;
+	DictQuery *query = dict_query_new(DICT_QUERY_SPELL, NULL, 0, NULL, NULL, arg_words);
+
+	dict_query_set_spell_checker(query, dd->spell_bin, dd->spell_dictionary);
+
+	dict_query_run_async(query, query_finished_cb, invocation);
+	return TRUE;
+}
+
+
+static gboolean on_handle_match(Dict *skeleton, GDBusMethodInvocation *invocation,
+	const gchar *arg_prefix, gpointer user_data)
+{
+	DictData *dd = user_data;
+	const gchar *words[] = { arg_prefix, NULL };
+	DictQuery *query = dict_query_new(DICT_QUERY_MATCH, dd->server, dd->port,
+		dd->dictionary, "prefix", words);
+
+	dict_query_run_async(query, query_finished_cb, invocation);
+	return TRUE;
+}
+
+
+static gboolean on_handle_get_stats(Dict *skeleton, GDBusMethodInvocation *invocation,
+	gpointer user_data)
+{
+	dict_complete_get_stats(skeleton, invocation, dict_stats_get_variant());
+	return TRUE;
+}
+
+
+static void on_bus_acquired(GDBusConnection *connection, const gchar *name,
 	gpointer user_data)
 {
 	Dict *skeleton = dict_skeleton_new();
 	g_signal_connect (skeleton, "handle-search", G_CALLBACK(on_handle_search), user_data);
+	g_signal_connect (skeleton, "handle-define", G_CALLBACK(on_handle_define), user_data);
+	g_signal_connect (skeleton, "handle-spell", G_CALLBACK(on_handle_spell), user_data);
+	g_signal_connect (skeleton, "handle-match", G_CALLBACK(on_handle_match), user_data);
+	g_signal_connect (skeleton, "handle-get-stats", G_CALLBACK(on_handle_get_stats), user_data);
 	g_dbus_interface_skeleton_export (G_DBUS_INTERFACE_SKELETON (skeleton),
 		connection, "/org/xfce/Dict", NULL);
 }
 
 
+static void on_name_lost(GDBusConnection *connection, const gchar *name, gpointer user_data)
+{
+	DictData *dd = user_data;
+
+	/* we stay in the queue and get the name back when the other owner is gone */
+	if (dd->verbose_mode && connection != NULL)
+		g_message("Another instance took over %s", name);
+}
+
+
+/* A daemon gives way to the panel plugin or a stand-alone window, as these can also
+ * show results. It also keeps DICT_DAEMON_NAME, so that xfce4-dict doesn't pass searches
+ * to it. */
 void dict_acquire_dbus_name(DictData *dd)
 {
 	g_bus_own_name(G_BUS_TYPE_SESSION,
       "org.xfce.Dict",
-      G_BUS_NAME_OWNER_FLAGS_NONE,
-      NULL,
-      on_name_acquired,
+      dd->is_daemon ? G_BUS_NAME_OWNER_FLAGS_ALLOW_REPLACEMENT : G_BUS_NAME_OWNER_FLAGS_REPLACE,
+      on_bus_acquired,
       NULL,
+      on_name_lost,
       dd,
       NULL);
+
+	if (dd->is_daemon)
+		g_bus_own_name(G_BUS_TYPE_SESSION,
+			DICT_DAEMON_NAME,
+			G_BUS_NAME_OWNER_FLAGS_NONE,
+			NULL,
+			NULL,
+			NULL,
+			NULL,
+			NULL);
 }
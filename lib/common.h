@@ -19,40 +19,31 @@
 #ifndef COMMON_H
 #define COMMON_H 1
 
-
-/* Returns: TRUE if ptr points to a non-zero value. */
-#define NZV(ptr) \
-	((ptr) && (ptr)[0])
+#include "query.h"
 
 
 #define DICT_FLAGS_FOCUS_PANEL_ENTRY	1
 #define DICT_FLAGS_MODE_DICT			2
 #define DICT_FLAGS_MODE_WEB				4
 #define DICT_FLAGS_MODE_SPELL			8
+#define DICT_FLAGS_MODE_ALL				16
 
 #define XFCE_DICT_SELECTION	"XFCE_DICT_SEL"
 
+/* owned by a --daemon in addition to org.xfce.Dict, tells it apart from the windows */
+#define DICT_DAEMON_NAME	"org.xfce.Dict.Daemon"
+
 
 typedef enum
 {
 	DICTMODE_DICT = 0,
 	DICTMODE_WEB,
 	DICTMODE_SPELL,
-	DICTMODE_LAST_USED
+	DICTMODE_LAST_USED,
+	DICTMODE_ALL		/* dictd, the local headword list and spell check at once */
 } dict_mode_t;
 
 
-enum
-{
-	NO_ERROR,
-	NO_CONNECTION,
-	NOTHING_FOUND,
-	NO_DATABASES,
-	UNKNOWN_DATABASE,
-	BAD_COMMAND,
-	SERVER_NOT_READY
-};
-
 #define TAG_HEADING "heading"
 #define TAG_ERROR "error"
 #define TAG_SUCCESS "success"
@@ -60,7 +51,9 @@ enum
 #define TAG_BOLD "bold"
 #define TAG_PHONETIC "phonetic"
 
-typedef struct
+typedef struct _DictData DictData;
+
+struct _DictData
 {
 	/* settings */
 	dict_mode_t mode_in_use;
@@ -68,10 +61,15 @@ typedef struct
 
 	gboolean show_panel_entry;
 	gint panel_entry_size;
+	gboolean prebuild_window;	/* panel plugin: create the main window before it is needed */
+	gboolean scan_selection;	/* show the definition of selected words in the scan popup */
 
 	gint port;
 	gchar *server;
 	gchar *dictionary;
+	gboolean server_suggestions;	/* ask the server for similar words along with DEFINE */
+	gchar *strategy;				/* MATCH strategy for listing headwords, empty for none */
+	gchar *headword_file;			/* local headword list for fuzzy matching, may be empty */
 
 	gchar *web_url;
 
@@ -80,17 +78,26 @@ typedef struct
 
 	gboolean verbose_mode;
 	gboolean is_plugin;	/* specify whether the panel plugin loaded or not */
+	gboolean is_daemon;	/* serving lookups over D-Bus without any window */
 
 	/* status values */
 	gchar *searched_word;  /* word to query the server */
+	guint search_id;	/* changes with every search and when going back or forward */
 	gboolean query_is_running;
+	guint query_search_id;	/* the search_id of the running dictd query */
 	gint query_status;
-	gchar *query_buffer;
+	struct _DictReply *query_reply;	/* the answer of the last dictd query */
+	GPtrArray *query_suggestions;		/* DictMatch items of similar words */
+	GPtrArray *query_matches;			/* DictMatch items found with the strategy */
+	struct _DictHeadwords *headwords;	/* loaded from headword_file when needed */
+	struct _DictHistory *history;		/* the searched words shown in main_combo */
 
 	/* main window's geometry */
 	gint geometry[5];
 
-	/* widgets */
+	/* widgets, the main window is created when it is needed first in the panel plugin */
+	void (*window_created)(DictData *dd, gpointer data);	/* called after it was created */
+	gpointer window_created_data;
 	GtkWidget *window;
 	GtkWidget *statusbar;
 	GtkWidget *close_button;
@@ -99,6 +106,8 @@ typedef struct
 	GtkWidget *main_combo;
 	GtkWidget *main_entry;
 	GtkWidget *radio_button_web;
+	GtkWidget *back_button;
+	GtkWidget *forward_button;
 	GtkWidget *panel_entry;
 	GtkWidget *main_textview;
 	GtkTextBuffer *main_textbuffer;
@@ -108,7 +117,10 @@ typedef struct
 	GtkTextTag *error_tag;
 	GtkTextTag *success_tag;
 	GtkTextMark *mark_click;
+	GQueue results_back;		/* GtkTextBuffers of the previous results, the latest first */
+	GQueue results_forward;		/* results left by going back, the closest first */
 	GdkPixbuf *icon;
+	struct _DictScanPopup *scan_popup;
 
 	GdkRGBA *color_link;
 	GdkRGBA *color_phonetic;
@@ -120,7 +132,7 @@ typedef struct
 	gint speedreader_grouping;
 	gchar *speedreader_font;
 	gboolean speedreader_mark_paragraphs;
-} DictData;
+};
 
 
 dict_mode_t dict_set_search_mode_from_flags(dict_mode_t mode, gchar flags);
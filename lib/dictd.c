@@ -16,9 +16,8 @@
  */
 
 
-/* This file contains all networking related code to query a remote (or local)
- * dictd server (RFC 2229). */
-/* TODO: This should be more separated from GUI code, sometime. */
+/* This file contains the code to query a remote (or local) dictd server (RFC 2229) and to
+ * display the results. The networking itself is done in query.c. */
 
 
 #ifdef HAVE_CONFIG_H
@@ -28,17 +27,9 @@
 #include <gtk/gtk.h>
 #include <libxfce4ui/libxfce4ui.h>
 
-#include <signal.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <sys/stat.h>
-#include <unistd.h>
-#include <netdb.h>
-#include <netinet/tcp.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
-#include <signal.h>
 #include <string.h>
+#include <time.h>
+#include <glib/gstdio.h>
 
 
 #include "common.h"
@@ -46,151 +37,37 @@
 #include "gui.h"
 #include "spell.h"
 #include "prefs.h"
+#include "arena.h"
+#include "dictparser.h"
+#include "query.h"
+#include "stats.h"
+#include "fuzzy.h"
+#include "cache.h"
 
 
-#define BUF_SIZE 256
+/* refresh the cached database list of a server after one day */
+#define DICT_DATABASE_CACHE_MAX_AGE		(24 * 60 * 60)
 
-
-
-static gint open_socket(const gchar *host_name, gint port)
+enum
 {
-	struct sockaddr_in addr;
-	struct hostent *host_p;
-	gint fd;
-	gint opt = 1;
-
-	memset((gchar *) &addr, 0, sizeof (addr));
-
-	if ((addr.sin_addr.s_addr = inet_addr(host_name)) == INADDR_NONE)
-	{
-		host_p = gethostbyname(host_name);
-		if (host_p == NULL)
-			return (-1);
-		memcpy((gchar *)(&addr.sin_addr), host_p->h_addr, (size_t)host_p->h_length);
-	}
-
-	addr.sin_family  = AF_INET;
-	addr.sin_port    = htons((gushort) port);
-
-	if ((fd = socket (AF_INET, SOCK_STREAM, 0)) < 0)
-		return (-1);
-
-	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (gchar *) &opt, sizeof (opt));
-
-	if (connect(fd, (struct sockaddr *) &addr, sizeof (addr)) != 0)
-	{
-		close(fd);
-		return (-1);
-	}
-	/*fcntl( fd, F_SETFL, O_NONBLOCK );*/
-
-	return (fd);
-}
-
-
-static void send_command(gint fd, const gchar *str)
-{
-	gchar buf[256];
-	gint len = strlen (str);
-
-	g_snprintf(buf, 256, "%s\r\n", str);
-	send(fd, buf, len + 2, 0);
-}
-
-
-static gchar *phon_find_start(gchar *buf, gchar **start_str, gchar **end_str)
-{
-	gchar *start;
-
-	/* we check only once for the various (\, / and [...]) formats for phonetic information
-	 * per line, for further occurrences on the same line we use the same format */
-	if (**start_str == '\0')
-	{
-		start = strchr(buf, '\\');
-		if (start != NULL)
-		{
-			*start_str = *end_str = "\\";
-		}
-		else
-		{
-			start = strchr(buf, '/');
-			if (start != NULL)
-			{
-				*start_str = *end_str = "/";
-			}
-			else
-			{
-				start = strchr(buf, '[');
-				if (start != NULL)
-				{
-					*start_str = "[";
-					*end_str = "]";
-				}
-			}
-		}
-	}
-	else
-	{
-		start = strchr(buf, **start_str);
-		if (start != NULL)
-		{
-			*start_str = *end_str = *start_str;
-		}
-	}
+	DB_COLUMN_TEXT,	/* as sent by the server, e.g. "wn "WordNet"" */
+	DB_COLUMN_NAME,	/* the database name only */
+	DB_N_COLUMNS
+};
 
-	return start;
-}
 
-
-/* We parse the first line differently as there are usually no links
- * but instead phonetic information */
-static void parse_header(DictData *dd, GString *buffer, GString *target)
+typedef struct
 {
-	gchar *start;
-	gchar *end;
-	gsize len;
-	gchar end_char;
-	gchar *start_str = "";
-	gchar *end_str = "";
+	DictData *dd;
+	gchar *word;
+	guint search_id;
+	GPtrArray *words;	/* similar headwords, the closest first */
+} LocalQuery;
 
-	while (buffer->len > 0)
-	{
-		start = phon_find_start(buffer->str, &start_str, &end_str);
-		end_char = *end_str;
-		len = 0;
 
-		if (start == NULL)
-		{
-			/* no phonetics at all, so add the text to the body to get at least possible
-			 * links parsed and return */
-			g_string_prepend(target, buffer->str);
-			g_string_erase(buffer, 0, -1); /* remove already handled text */
-			return;
-		}
-		/* get length of text *before* the end char */
-		while (len < buffer->len && (buffer->str + len) != start)
-			len++;
+/* dd->headwords is shared by the dictd and the local query threads */
+G_LOCK_DEFINE_STATIC(headwords);
 
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, buffer->str, len);
-		len++; /* skip the end char */
-		g_string_erase(buffer, 0, len); /* remove already handled text */
-
-		start = buffer->str; /* set new start */
-		end = strchr(start, end_char);
-		if (start > end)
-		{
-			/* start & end chars don't match, skip this part */
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, start_str, 1);
-			continue;
-		}
-		len = end - buffer->str; /* length of the phonetic string */
-
-		gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
-				buffer->str, len, TAG_PHONETIC, NULL);
-
-		g_string_erase(buffer, 0, len + 1); /* remove already handled text */
-	}
-}
 
 
 static GtkTextTag *create_tag(DictData *dd, const gchar *link_str)
@@ -202,176 +79,137 @@ static GtkTextTag *create_tag(DictData *dd, const gchar *link_str)
 		"foreground-rgba", dd->color_link, NULL);
 
 	g_object_set_data_full(G_OBJECT(tag), TAG_LINK, g_strdup(link_str), g_free);
+	/* the tag table is shared by the kept results, the tag is removed with its buffer */
+	g_object_set_data(G_OBJECT(tag), DICT_TAG_BUFFER, dd->main_textbuffer);
 
 	return tag;
 }
 
 
-/* ignore links like {n} or {f} as they are often found in translation dictionaries and
- * used for giving additional type information but not intended to link or reference something */
-static gboolean ignore_short_link(const gchar *str)
+/* Inserts a definition with its phonetics and cross-references highlighted, the
+ * cross-referenced words are appended to 'links', they are allocated from 'arena' */
+static void insert_definition(DictData *dd, DictDefinition *def, GString *text, GArray *spans,
+							  GPtrArray *links, DictArena *arena)
 {
-	if (str == NULL)
-		return TRUE;
-
-	/* ignore {n}, {f}, {m}  (surrounding braces are already stripped in 'str') */
-	if (strcmp("f", str) == 0 ||
-		strcmp("m", str) == 0 ||
-		strcmp("n", str) == 0 ||
-		strcmp("vr", str) == 0 ||
-		strcmp("vt", str) == 0 ||
-		strcmp("pl", str) == 0)
-	{
-		return TRUE;
-	}
-
-	return FALSE;
-}
+	DictSpan *span;
+	gsize pos = 0;
+	guint i;
 
+	gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+		def->description, -1, TAG_BOLD, NULL);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, " (", 2);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, def->database, -1);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, ")\n", 2);
 
-/* Find any cross-references like {reference} and make them clickable */
-static void parse_body(DictData *dd, GString *buffer)
-{
-	gchar *start;
-	gchar *end;
-	gsize len;
-	GtkTextTag *tag;
-	gchar *found_link;
+	g_string_truncate(text, 0);
+	g_array_set_size(spans, 0);
+	dict_parser_markup(def->definition, text, spans, arena);
 
-	while (buffer->len > 0)
+	for (i = 0; i < spans->len; i++)
 	{
-		start = strchr(buffer->str, '{');
-		len = 0;
-
-		if (start == NULL)
-		{	/* no links at all, so add the text and go */
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, buffer->str, buffer->len);
-			return;
-		}
-		/* get length of text *before* the next '{' */
-		while (len < buffer->len && (buffer->str + len) != start)
-			len++;
-
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, buffer->str, len);
-		len++; /* skip the '{' */
-		g_string_erase(buffer, 0, len); /* remove already handled text */
-
-		start = buffer->str; /* set new start */
-		end = strchr(start, '}');
-		if (start > end)
-		{
-			/* braces don't match, skip this part, e.g. 'fd-deu-eng' returns
-			 * '    frozen}; to be cold; to freeze {froze' */
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "{", 1);
-			continue;
-		}
-		len = end - buffer->str; /* length of the link */
-		found_link = g_strndup(buffer->str, len);
+		span = &g_array_index(spans, DictSpan, i);
+		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter,
+			text->str + pos, span->start - pos);
 
-		/* ignore {n}, {f}, ... */
-		if (ignore_short_link(found_link))
-		{
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "{", 1);
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, buffer->str, len);
-			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "}", 1);
-		}
+		if (span->type == DICT_SPAN_PHONETIC)
+			gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+				text->str + span->start, span->len, TAG_PHONETIC, NULL);
 		else
 		{
-			tag = create_tag(dd, found_link);
+			gchar *link = dict_arena_strndup(arena, text->str + span->start, span->len);
+
 			gtk_text_buffer_insert_with_tags(dd->main_textbuffer, &dd->textiter,
-				buffer->str, len, tag, NULL);
+				link, span->len, create_tag(dd, link), NULL);
+			/* searches are done for the word without surrounding whitespace */
+			g_ptr_array_add(links, g_strstrip(link));
 		}
-		g_free(found_link);
-		g_string_erase(buffer, 0, len + 1); /* remove already handled text */
+		pos = span->start + span->len;
 	}
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, text->str + pos, text->len - pos);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n\n", 2);
 }
 
 
-static gint process_response_content(DictData *dd, gchar **lines, gint line_no, gint max_lines,
-									 GString *header, GString *body)
+static void clear_query_buffer(DictData *dd)
 {
-	gchar **dict_parts;
-	gboolean is_header;
-
-	line_no++;
-	if (strncmp(lines[line_no], "250", 3) == 0)
-		return max_lines; /* end of data */
-	if (strncmp(lines[line_no], "error:", 6) == 0) /* an error occurred */
+	dict_reply_free(dd->query_reply);
+	dd->query_reply = NULL;
+	if (dd->query_suggestions != NULL)
+	{
+		g_ptr_array_free(dd->query_suggestions, TRUE);
+		dd->query_suggestions = NULL;
+	}
+	if (dd->query_matches != NULL)
 	{
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, lines[line_no], -1);
-		return max_lines;
+		g_ptr_array_free(dd->query_matches, TRUE);
+		dd->query_matches = NULL;
 	}
-	if (strncmp(lines[line_no], "151", 3) != 0)
-		return line_no; /* unexpected line start, try next line */
+}
 
-	/* get the used dictionary */
-	dict_parts = g_strsplit(lines[line_no], "\"", -1);
 
-	if (g_strv_length(dict_parts) > 3)
-	{	gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
-			g_strstrip(dict_parts[3]), -1, TAG_BOLD, NULL);
+static void insert_links(DictData *dd, GPtrArray *matches)
+{
+	DictMatch *match;
+	guint i;
 
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, " (", 2);
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter,
-			g_strstrip(dict_parts[2]), -1);
-		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, ")\n", 2);
+	for (i = 0; i < matches->len; i++)
+	{
+		match = g_ptr_array_index(matches, i);
+		if (i > 0)
+			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, ", ", 2);
+		gtk_text_buffer_insert_with_tags(dd->main_textbuffer, &dd->textiter,
+			match->word, -1, create_tag(dd, match->word), NULL);
 	}
-	g_strfreev(dict_parts);
+}
 
-	if (line_no >= (max_lines - 2))
-		return max_lines;
 
-	/* all following lines represents the translation */
-	line_no++;
-	is_header = TRUE;
+/* Inserts the similar words found by the server as links.
+ * Returns FALSE if there were none. */
+static gboolean insert_suggestions(DictData *dd)
+{
+	gchar *text;
 
-	while (lines[line_no] != NULL && lines[line_no][0] != '\r' && lines[line_no][0] != '\n')
-	{
-		/* check for a leading period indicating end of text response */
-		if (lines[line_no][0] == '.')
-		{
-			/* a double period at line start is a masked period, cf. RFC 2229 */
-			if (strlen(lines[line_no]) > 1 && lines[line_no][1] == '.')
-				/* the RFC says we should coolapse the two periods into one but we go the
-				 * lazy way and simply replace the first period by a space */
-				lines[line_no][0] = ' ';
-			else
-				break; /* we reached the end of the test response */
-		}
-		if (is_header && lines[line_no][0] != ' ')
-		{
-			g_string_append(header, lines[line_no]);
-			g_string_append_c(header, '\n');
-		}
-		else
-		{
-			g_string_append(body, lines[line_no]);
-			g_string_append_c(body, '\n');
-			is_header = FALSE;
-		}
+	if (dd->query_suggestions == NULL || dd->query_suggestions->len == 0)
+		return FALSE;
 
-		line_no++;
-	}
-	parse_header(dd, header, body);
-	parse_body(dd, body);
 	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n\n", 2);
-	g_string_erase(header, 0, -1);
-	g_string_erase(body, 0, -1);
+	text = g_strdup_printf(_("Suggestions for \"%s\" (%s):"), dd->searched_word, dd->server);
+	gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+		text, -1, TAG_BOLD, NULL);
+	dict_gui_textview_apply_tag_to_word(dd->main_textbuffer, dd->searched_word, &dd->textiter,
+		TAG_ERROR, TAG_BOLD, NULL);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+	g_free(text);
 
-	return line_no;
+	insert_links(dd, dd->query_suggestions);
+	return TRUE;
 }
 
 
-static void clear_query_buffer(DictData *dd)
+/* Inserts the headwords found with the configured search strategy as links.
+ * Returns FALSE if there were none. */
+static gboolean insert_matches(DictData *dd)
 {
-	g_free(dd->query_buffer);
-	dd->query_buffer = NULL;
+	gchar *text;
+
+	if (dd->query_matches == NULL || dd->query_matches->len == 0)
+		return FALSE;
+
+	text = g_strdup_printf(_("Matching headwords (%s):"), dd->strategy);
+	gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+		text, -1, TAG_BOLD, NULL);
+	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+	g_free(text);
+
+	insert_links(dd, dd->query_matches);
+	return TRUE;
 }
 
 
 static void append_web_search_link(DictData *dd, gboolean prepend_whitespace)
 {
-	if (dd->web_url == NULL || dd->mode_in_use != DICTMODE_DICT)
+	if (dd->web_url == NULL ||
+		(dd->mode_in_use != DICTMODE_DICT && dd->mode_in_use != DICTMODE_ALL))
 		return;
 
 	gchar *label = _(dict_prefs_get_web_url_label(dd));
@@ -396,12 +234,24 @@ static void append_web_search_link(DictData *dd, gboolean prepend_whitespace)
 
 static gboolean process_server_response(DictData *dd)
 {
-	gint max_lines, i;
-	gint defs_found = 0;
-	gchar *answer, *tmp;
-	gchar **lines;
-	GString *header = g_string_sized_new(256);
-	GString *body = g_string_sized_new(512);
+	guint i, defs_found;
+	gchar *tmp;
+	GString *text;
+	GArray *spans;
+	GPtrArray *links;
+	DictArena *arena;
+	DictReply *reply;
+	gint64 start;
+	gboolean found, sections;
+
+	dd->query_is_running = FALSE;
+
+	/* another search was started or other results were shown in the meantime */
+	if (dd->query_search_id != dd->search_id)
+	{
+		clear_query_buffer(dd);
+		return FALSE;
+	}
 
 	switch (dd->query_status)
 	{
@@ -409,6 +259,7 @@ static gboolean process_server_response(DictData *dd)
 		{
 			dict_gui_status_add(dd, _("Could not connect to server."));
 			dd->query_status = NO_ERROR;
+			clear_query_buffer(dd);
 			return FALSE;
 		}
 		case SERVER_NOT_READY:
@@ -426,19 +277,17 @@ static gboolean process_server_response(DictData *dd)
 		}
 	}
 
-	if (! NZV(dd->query_buffer))
+	/* in DICTMODE_ALL the other backends may have inserted text in the meantime */
+	sections = dict_gui_section_get_iter(dd, DICT_SECTION_DICTD);
+
+	reply = dd->query_reply;
+	if (reply == NULL || reply->code == -1)
 	{
 		dict_gui_status_add(dd, _("Unknown error while querying the server."));
 		clear_query_buffer(dd);
 		return FALSE;
 	}
 
-	answer = dd->query_buffer;
-	/* go to next line */
-	while (*answer != '\n')
-		answer++;
-	answer++;
-
 	if (dd->query_status == NOTHING_FOUND)
 	{
 		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
@@ -452,13 +301,22 @@ static gboolean process_server_response(DictData *dd)
 			TAG_ERROR, TAG_BOLD, NULL);
 		dict_gui_status_add(dd, "%s", tmp);
 		g_free(tmp);
+
+		/* if we had no luck searching a word, maybe we have a typo so show similar words
+		 * the server found or try searching with spell check and offer a Web search */
+		found = FALSE;
+		if (dd->query_matches != NULL && dd->query_matches->len > 0)
+		{
+			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n\n", 2);
+			found = insert_matches(dd);
+		}
+		found = insert_suggestions(dd) || found;
 		clear_query_buffer(dd);
 
-		/* if we had no luck searching a word, maybe we have a typo so try searching with
-		 * spell check and offer a Web search*/
 		append_web_search_link (dd, TRUE);
 
-		if (NZV(dd->spell_bin))
+		/* the spell checker runs anyway if all backends are used */
+		if (! found && NZV(dd->spell_bin) && ! sections)
 		{
 			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
 			dict_spell_start_query(dd, dd->searched_word, FALSE);
@@ -466,213 +324,268 @@ static gboolean process_server_response(DictData *dd)
 
 		return FALSE;
 	}
-	else if (strncmp("150", answer, 3) != 0 && dd->query_status != NOTHING_FOUND)
+	else if (reply->definitions->len == 0)
 	{
 		dict_gui_status_add(dd, _("Unknown error while querying the server."));
 		clear_query_buffer(dd);
 		return FALSE;
 	}
-	defs_found = atoi(answer + 4);
+	defs_found = reply->definitions->len;
 	dict_gui_status_add(dd, ngettext("%d definition found.",
                                      "%d definitions found.",
                                      defs_found), defs_found);
 
-	/* go to next line */
-	while (*answer != '\n')
-		answer++;
-	answer++;
-
-	/* parse output */
-	lines = g_strsplit(answer, "\r\n", -1);
-	max_lines = g_strv_length(lines);
-	if (lines == NULL || max_lines == 0)
-	{
-		clear_query_buffer(dd);
-		return FALSE;
-	}
-
-	gtk_text_buffer_get_start_iter(dd->main_textbuffer, &dd->textiter);
+	if (! sections)
+		gtk_text_buffer_get_start_iter(dd->main_textbuffer, &dd->textiter);
 	gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
 
-	i = -1;
-	while (i < max_lines)
-	{
-		i = process_response_content(dd, lines, i, max_lines, header, body);
-	}
+	start = dict_stats_start();
+	text = g_string_sized_new(1024);
+	spans = g_array_new(FALSE, FALSE, sizeof(DictSpan));
+	/* the temporary strings of rendering are released at once when it is done */
+	arena = dict_arena_new(0);
+	links = g_ptr_array_new();
+	for (i = 0; i < defs_found; i++)
+		insert_definition(dd, g_ptr_array_index(reply->definitions, i), text, spans, links, arena);
+	g_string_free(text, TRUE);
+	g_array_free(spans, TRUE);
+	if (insert_matches(dd))
+		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n\n", 2);
+	dict_stats_end(DICT_STATS_RENDER, start);
+
+	/* fetch the definitions of the first cross-references in the background, they are
+	 * followed often and are shown from the cache then */
+	g_ptr_array_add(links, NULL);
+	dict_query_prefetch(dd->server, dd->port, dd->dictionary,
+		(const gchar * const *) links->pdata);
+	g_ptr_array_free(links, TRUE);
+	dict_arena_free(arena);
 
 	append_web_search_link (dd, FALSE);
 
-	g_strfreev(lines);
 	clear_query_buffer(dd);
 
-	g_string_free(header, TRUE);
-	g_string_free(body, TRUE);
-
 	return FALSE;
 }
 
 
-static gint get_answer(gint fd, gchar **buffer)
+/* Collects the matches of the replies to the MATCH commands, without duplicates and
+ * without the searched word itself */
+static GPtrArray *collect_suggestions(DictData *dd, DictReply **replies, guint n_replies)
 {
-	gboolean fol = TRUE;
-	gboolean sol = FALSE;
-	gboolean tol = FALSE;
-	GString *str;
-	gchar c;
-	gchar ec[3];
-	gint query_status = NO_ERROR;
+	GPtrArray *suggestions = g_ptr_array_new_with_free_func((GDestroyNotify) dict_match_free);
+	GHashTable *seen = g_hash_table_new(g_str_hash, g_str_equal);
+	DictMatch *match;
+	guint i, j;
 
-	if (buffer != NULL)
-		str = g_string_sized_new(100);
-
-	alarm(10); /* abort after 10 seconds, there should went wrong something */
-	while (read(fd, &c, 1) > 0)
+	g_hash_table_add(seen, dd->searched_word);
+	for (i = 0; i < n_replies; i++)
 	{
-		if (tol) /* third char of line */
-		{
-			ec[2] = c;
-		}
-		if (sol) /* second char of line */
-		{
-			ec[1] = c;
-			sol = FALSE;
-			tol = TRUE;
-		}
-		if (fol) /* first char of line */
-		{
-			ec[0] = c;
-			fol = FALSE;
-			sol = TRUE;
-		}
-		if (c == '\n') /* last char of line, so the next run is first char of next line */
+		for (j = 0; j < replies[i]->matches->len; j++)
 		{
-			fol = TRUE;
-			sol = FALSE;
-			tol = FALSE;
-		}
-
-		if (buffer != NULL)
-			g_string_append_c(str, c);
-
-		if (tol)
-		{
-			if (strncmp(ec, "250", 3) == 0 || 	/* ok */
-				strncmp(ec, "500", 3) == 0 ||	/* unknown command */
-				strncmp(ec, "501", 3) == 0)		/* syntax error */
-			{
-				break;
-			}
-			else if (strncmp(ec, "220", 3) == 0 ||	/* server ready */
-					 strncmp(ec, "221", 3) == 0)	/* good bye */
-			{
-				query_status = NO_ERROR;
-				break;
-			}
-			else if (strncmp(ec, "420", 3) == 0 ||
-					 strncmp(ec, "421", 3) == 0) /* server not ready (server down or shutdown) */
-			{
-				query_status = SERVER_NOT_READY;
-				break;
-			}
-			else if (strncmp(ec, "500", 3) == 0 ||
-					 strncmp(ec, "501", 3) == 0) /* bad command or parameters */
-			{
-				query_status = BAD_COMMAND;
-				break;
-			}
-			else if (strncmp(ec, "550", 3) == 0) /* invalid database */
-			{
-				query_status = UNKNOWN_DATABASE;
-				break;
-			}
-			else if (strncmp(ec, "552", 3) == 0) /* nothing found */
-			{
-				query_status = NOTHING_FOUND;
-				break;
-			}
-			else if (strncmp(ec, "554", 3) == 0) /* no databases present */
+			match = g_ptr_array_index(replies[i]->matches, j);
+			if (g_hash_table_contains(seen, match->word))
+				dict_match_free(match);
+			else
 			{
-				query_status = NO_DATABASES;
-				break;
+				g_hash_table_add(seen, match->word);
+				g_ptr_array_add(suggestions, match);
 			}
 		}
+		/* the matches are freed or owned by 'suggestions' now */
+		g_ptr_array_set_free_func(replies[i]->matches, NULL);
+		g_ptr_array_set_size(replies[i]->matches, 0);
 	}
-	alarm(0);
+	g_hash_table_destroy(seen);
 
-	if (buffer != NULL)
-	{
-		g_string_append_c(str, '\0');
-		*buffer = g_string_free(str, FALSE);
-	}
+	return suggestions;
+}
 
-	return query_status;
+
+/* Takes the matches out of a reply, the reply itself can be freed afterwards */
+static GPtrArray *steal_matches(DictReply *reply)
+{
+	GPtrArray *matches = reply->matches;
+
+	reply->matches = g_ptr_array_new_with_free_func((GDestroyNotify) dict_match_free);
+	return matches;
 }
 
 
-static gpointer ask_server(DictData *dd)
+/* Returns DictMatch items for the headwords of the local list within max_distance
+ * edits of the searched word */
+static GPtrArray *local_matches(DictData *dd, guint max_distance, guint max_results)
 {
-	gint fd, i;
-	static gchar cmd[BUF_SIZE];
+	GPtrArray *matches = g_ptr_array_new_with_free_func((GDestroyNotify) dict_match_free);
+	GPtrArray *words;
+	DictMatch *match;
+	guint i;
 
-	if ((fd = open_socket(dd->server, dd->port)) == -1)
+	if (dd->headwords == NULL)
+		return matches;
+
+	words = dict_headwords_fuzzy(dd->headwords, dd->searched_word, max_distance, max_results);
+	for (i = 0; i < words->len; i++)
 	{
-		dd->query_status = NO_CONNECTION;
-		g_idle_add((GSourceFunc) process_server_response, dd);
-		g_thread_exit(NULL);
-		return NULL;
+		if (g_ascii_strcasecmp(g_ptr_array_index(words, i), dd->searched_word) == 0)
+			continue;
+		match = g_new0(DictMatch, 1);
+		match->database = g_strdup("local");
+		/* take over the string, the array does not free it then */
+		match->word = g_ptr_array_index(words, i);
+		words->pdata[i] = NULL;
+		g_ptr_array_add(matches, match);
 	}
-	dd->query_is_running = TRUE;
-	dd->query_status = NO_CONNECTION;
+	g_ptr_array_free(words, TRUE);
 
-	dd->query_status = get_answer(fd, NULL);
-	if (dd->query_status == NO_ERROR)
-	{
-		/* take only the first part of the dictionary string, so let the string end at the space */
-		i = 0;
-		while (dd->dictionary[i] != ' ')
-			i++;
-		dd->dictionary[i] = '\0';
+	return matches;
+}
 
-		g_snprintf(cmd, BUF_SIZE, "DEFINE %s \"%s\"", dd->dictionary, dd->searched_word);
-		send_command(fd, cmd);
 
-		/* and now, "append" again the rest of the dictionary string again */
-		dd->dictionary[i] = ' ';
+/* (Re)loads the local headword list if it is configured and has changed */
+static void load_headwords(DictData *dd)
+{
+	GError *error = NULL;
 
-		dd->query_status = get_answer(fd, &(dd->query_buffer));
+	if (dd->headwords != NULL &&
+		(! NZV(dd->headword_file) ||
+		 ! g_str_equal(dict_headwords_get_filename(dd->headwords), dd->headword_file)))
+	{
+		dict_headwords_free(dd->headwords);
+		dd->headwords = NULL;
 	}
-	send_command(fd, "QUIT");
-	get_answer(fd, NULL);
-	close(fd);
-
-	dd->query_is_running = FALSE;
-	/* delegate parsing the response and related GUI stuff to GTK's main thread through the main loop */
-	g_idle_add((GSourceFunc) process_server_response, dd);
+	if (dd->headwords != NULL || ! NZV(dd->headword_file))
+		return;
 
-	g_thread_exit(NULL);
-	return NULL;
+	dd->headwords = dict_headwords_new_from_file(dd->headword_file, &error);
+	if (dd->headwords == NULL)
+	{
+		g_warning("Could not read headword list: %s", error->message);
+		g_error_free(error);
+	}
+	else if (dd->verbose_mode)
+		g_message("Loaded %u headwords from %s",
+			dict_headwords_get_count(dd->headwords), dd->headword_file);
 }
 
 
-static void signal_cb(gint sig)
+/* Returns a successful reply holding the definitions, e.g. from the cache */
+static DictReply *cached_reply(GPtrArray *definitions)
 {
-	/* do nothing here and hope we never get called */
+	DictReply *reply = dict_parser_parse("250 ok (cached)\r\n", -1);
+
+	g_ptr_array_free(reply->definitions, TRUE);
+	reply->definitions = definitions;
+	return reply;
 }
 
 
-static void dictd_init(void)
+static gpointer ask_server(DictData *dd)
 {
-#ifdef SIGALRM
-	static gboolean initialized = FALSE;
+	DictConnection *conn;
+	DictReply *replies[4];
+	GPtrArray *cached;
+	gchar *database, *word;
+	gchar *commands[5] = { NULL };
+	gboolean local_lev, local_suggestions;
+	gint define_idx = -1, match_idx = -1, suggestions_idx = -1;
+	guint i, n = 0;
+
+	G_LOCK(headwords);
+	load_headwords(dd);
+	/* the local list answers Levenshtein searches without asking the server */
+	local_lev = dd->headwords != NULL && g_strcmp0(dd->strategy, "lev") == 0;
+	local_suggestions = dd->headwords != NULL && dd->server_suggestions;
+	G_UNLOCK(headwords);
+
+	/* take only the first part of the dictionary string */
+	database = dict_query_database_name(dd->dictionary);
+	word = dict_query_quote_word(dd->searched_word);
+
+	/* e.g. the word of a link which is just being prefetched, its definitions are cached
+	 * afterwards */
+	dict_query_join_define(dd->server, dd->port, database, dd->searched_word);
+
+	/* the suggestions are only needed if nothing was found, so only the headwords of the
+	 * strategy are left to ask for if the definitions are cached */
+	cached = dict_cache_lookup(dd->server, dd->port, database, dd->searched_word);
+	if (cached == NULL)
+	{
+		define_idx = n;
+		commands[n++] = g_strdup_printf("DEFINE %s \"%s\"", database, word);
+	}
+	if (NZV(dd->strategy) && ! local_lev)
+	{
+		match_idx = n;
+		commands[n++] = g_strdup_printf("MATCH %s %s \"%s\"", database, dd->strategy, word);
+	}
+	if (cached == NULL && dd->server_suggestions && ! local_suggestions)
+	{
+		/* ask for similar words in the same round trip, they are shown if nothing
+		 * was found which saves running the spell checker */
+		suggestions_idx = n;
+		commands[n++] = g_strdup_printf("MATCH %s lev \"%s\"", database, word);
+		commands[n++] = g_strdup_printf("MATCH %s soundex \"%s\"", database, word);
+	}
+
+	dd->query_status = NO_ERROR;
+	/* a connection opened in advance by dict_dictd_warm_up() is used if there is one */
+	conn = (n > 0) ? dict_connection_pool_get(dd->server, dd->port, &dd->query_status) : NULL;
+	if (conn != NULL)
+	{
+		dd->query_status = dict_connection_commands(conn, (const gchar * const *) commands,
+			replies);
+		dict_connection_pool_put(conn);
+	}
+	else
+	{
+		for (i = 0; i < n; i++)
+			replies[i] = dict_parser_finish(dict_parser_new());
+	}
+
+	if (cached != NULL)
+	{
+		/* the definitions are there even if the server can't be reached right now */
+		dd->query_status = NO_ERROR;
+		dd->query_reply = cached_reply(cached);
+	}
+	else if (conn != NULL)
+	{
+		dd->query_reply = replies[define_idx];
+		replies[define_idx] = NULL;
+		if (dd->query_status == NO_ERROR)
+			dict_cache_insert(dd->server, dd->port, database, dd->searched_word,
+				dd->query_reply->definitions);
+	}
 
-	if (G_UNLIKELY(! initialized))
+	if (cached != NULL || conn != NULL)
 	{
-		siginterrupt(SIGALRM, 1);
-		signal(SIGALRM, signal_cb);
+		G_LOCK(headwords);
+		if (match_idx >= 0)
+			dd->query_matches = steal_matches(replies[match_idx]);
+		else if (local_lev)
+			dd->query_matches = local_matches(dd, 1, 100);
+		if (suggestions_idx >= 0)
+			dd->query_suggestions = collect_suggestions(dd, replies + suggestions_idx, 2);
+		else if (local_suggestions && cached == NULL)
+			dd->query_suggestions = local_matches(dd, 2, 20);
+		G_UNLOCK(headwords);
+	}
 
-		initialized = TRUE;
+	for (i = 0; i < n; i++)
+	{
+		dict_reply_free(replies[i]);
+		g_free(commands[i]);
 	}
-#endif
+	g_free(word);
+	g_free(database);
+
+	/* delegate parsing the response and related GUI stuff to GTK's main thread through the
+	 * main loop, the query counts as running until that is done */
+	g_idle_add((GSourceFunc) process_server_response, dd);
+
+	g_thread_exit(NULL);
+	return NULL;
 }
 
 
@@ -685,8 +598,8 @@ void dict_dictd_start_query(DictData *dd, const gchar *word)
 	else
 	{
 		dict_gui_status_add(dd, _("Querying %s..."), dd->server);
-
-		dictd_init();
+		dd->query_is_running = TRUE;
+		dd->query_search_id = dd->search_id;
 
 		/* start the thread to query the server */
 		g_thread_new(NULL, (GThreadFunc) ask_server, dd);
@@ -694,71 +607,230 @@ void dict_dictd_start_query(DictData *dd, const gchar *word)
 }
 
 
-void dict_dictd_get_information(GtkWidget *button, DictData *dd)
+/* Connects to the server in the background when a search is likely to follow, e.g. when
+ * the user starts typing */
+void dict_dictd_warm_up(DictData *dd)
 {
-	gint fd;
-	gchar *buffer = NULL;
-	gchar *answer = NULL;
-	gchar *text, *end;
-	GtkEntry *entry_server = g_object_get_data(G_OBJECT(button), "server_entry");
-	GtkSpinButton *entry_port = g_object_get_data(G_OBJECT(button), "port_spinner");
-	const gchar *server;
+	if (dd->query_is_running ||
+		(dd->mode_in_use != DICTMODE_DICT && dd->mode_in_use != DICTMODE_ALL))
+		return;
+
+	dict_connection_pool_warm_up(dd->server, dd->port);
+}
+
+
+static gboolean process_local_response(LocalQuery *lq)
+{
+	DictData *dd = lq->dd;
+	gchar *text;
+	const gchar *word;
+	guint i = 0;
+
+	/* drop the result if another search was started or other results were shown in the
+	 * meantime */
+	if (lq->words != NULL && lq->search_id == dd->search_id &&
+		dict_gui_section_get_iter(dd, DICT_SECTION_LOCAL))
+	{
+		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+		gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+			_("Local Headword List:"), -1, TAG_HEADING, NULL);
+		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+
+		if (lq->words->len > 0 &&
+			g_ascii_strcasecmp(g_ptr_array_index(lq->words, 0), lq->word) == 0)
+		{
+			text = g_strdup_printf(_("\"%s\" is a headword."), lq->word);
+			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, text, -1);
+			dict_gui_textview_apply_tag_to_word(dd->main_textbuffer, lq->word, &dd->textiter,
+				TAG_SUCCESS, TAG_BOLD, NULL);
+			g_free(text);
+			i = 1;
+		}
+		else if (lq->words->len == 0)
+		{
+			text = g_strdup_printf(_("No similar headwords could be found for \"%s\"."), lq->word);
+			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, text, -1);
+			dict_gui_textview_apply_tag_to_word(dd->main_textbuffer, lq->word, &dd->textiter,
+				TAG_ERROR, TAG_BOLD, NULL);
+			g_free(text);
+		}
+
+		if (i < lq->words->len)
+		{
+			if (i > 0)
+				gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+			gtk_text_buffer_insert_with_tags_by_name(dd->main_textbuffer, &dd->textiter,
+				_("Similar headwords:"), -1, TAG_BOLD, NULL);
+			gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+			for (; i < lq->words->len; i++)
+			{
+				word = g_ptr_array_index(lq->words, i);
+				gtk_text_buffer_insert_with_tags(dd->main_textbuffer, &dd->textiter,
+					word, -1, create_tag(dd, word), NULL);
+				if (i + 1 < lq->words->len)
+					gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, ", ", 2);
+			}
+		}
+		gtk_text_buffer_insert(dd->main_textbuffer, &dd->textiter, "\n", 1);
+	}
+
+	if (lq->words != NULL)
+		g_ptr_array_free(lq->words, TRUE);
+	g_free(lq->word);
+	g_free(lq);
+
+	return FALSE;
+}
+
+
+static gpointer ask_local(LocalQuery *lq)
+{
+	G_LOCK(headwords);
+	load_headwords(lq->dd);
+	if (lq->dd->headwords != NULL)
+		lq->words = dict_headwords_fuzzy(lq->dd->headwords, lq->word, 2, 20);
+	G_UNLOCK(headwords);
+
+	g_idle_add((GSourceFunc) process_local_response, lq);
+
+	g_thread_exit(NULL);
+	return NULL;
+}
+
+
+/* Looks up the word in the local headword list, if one is configured */
+void dict_dictd_start_local_query(DictData *dd, const gchar *word)
+{
+	LocalQuery *lq;
+
+	if (! NZV(dd->headword_file))
+		return;
+
+	lq = g_new0(LocalQuery, 1);
+	lq->dd = dd;
+	lq->word = g_strdup(word);
+	lq->search_id = dd->search_id;
+
+	g_thread_new(NULL, (GThreadFunc) ask_local, lq);
+}
+
+
+typedef struct
+{
+	DictData *dd;
+	gchar *server;
 	gint port;
-	GtkWidget *dialog, *label, *swin, *vbox;
+	gint status;
+	DictReply *reply;		/* the answer to SHOW SERVER */
+	gint64 connect_time;	/* all times in microseconds */
+	gint64 round_trip;
+	gint64 transfer_time;
+} ServerInfoJob;
 
-	dictd_init();
 
-	server = gtk_entry_get_text(entry_server);
-	port = gtk_spin_button_get_value_as_int(entry_port);
+static void server_info_job_free(ServerInfoJob *job)
+{
+	g_free(job->server);
+	dict_reply_free(job->reply);
+	g_free(job);
+}
+
 
-	if ((fd = open_socket(server, port)) == -1)
+static void server_info_thread(GTask *task, gpointer source, gpointer data,
+							   GCancellable *cancellable)
+{
+	ServerInfoJob *job = data;
+	DictConnection *conn;
+	gint64 start;
+
+	start = g_get_monotonic_time();
+	if ((conn = dict_connection_open(job->server, job->port, &job->status)) == NULL)
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
+		g_task_return_boolean(task, FALSE);
 		return;
 	}
+	job->connect_time = g_get_monotonic_time() - start;
 
-	dd->query_status = NO_CONNECTION;
+	/* STATUS has a one line answer, so it shows the latency of the server alone */
+	start = g_get_monotonic_time();
+	job->status = dict_connection_command(conn, "STATUS", NULL);
+	job->round_trip = g_get_monotonic_time() - start;
 
-	dd->query_status = get_answer(fd, NULL);
-	if (dd->query_status != NO_ERROR)
+	if (job->status == NO_ERROR && ! g_cancellable_is_cancelled(cancellable))
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
-		return;
+		start = g_get_monotonic_time();
+		job->status = dict_connection_command(conn, "SHOW SERVER", &job->reply);
+		job->transfer_time = g_get_monotonic_time() - start;
 	}
+	dict_connection_close(conn);
 
-	send_command(fd, "SHOW SERVER");
+	g_task_return_boolean(task, job->status == NO_ERROR);
+}
 
-	/* read all server output */
-	dd->query_status = get_answer(fd, &answer);
-	buffer = answer;
-	send_command(fd, "QUIT");
-	get_answer(fd, NULL);
-	close(fd);
 
-	/* go to next line */
-	while (*buffer != '\n')
-		buffer++;
-	buffer++;
+static void server_info_finished(GObject *source, GAsyncResult *res, gpointer data)
+{
+	GtkWidget *dialog = GTK_WIDGET(source);
+	ServerInfoJob *job = g_task_get_task_data(G_TASK(res));
+	DictData *dd = job->dd;
+	GtkWidget *label;
+	gchar *text;
+	gdouble throughput = 0;
+
+	/* the dialog was closed before the server answered */
+	if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(res))))
+		return;
 
-	if (strncmp("114", buffer, 3) != 0)
+	if (job->status != NO_ERROR || job->reply == NULL || job->reply->text->len == 0)
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR,
-			_("An error occurred while querying server information."));
+		gtk_widget_destroy(dialog);
+		if (job->status == NO_CONNECTION)
+			dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
+		else
+			dict_show_msgbox(dd, GTK_MESSAGE_ERROR,
+				_("An error occurred while querying server information."));
 		return;
 	}
 
-	/* go to next line */
-	while (*buffer != '\n')
-		buffer++;
+	gtk_widget_hide(g_object_get_data(G_OBJECT(dialog), "progress_box"));
+
+	if (job->transfer_time > 0)
+		throughput = job->reply->raw->len / 1024.0 / (job->transfer_time / (gdouble) G_USEC_PER_SEC);
+	text = g_strdup_printf(
+		_("Connection setup: %.1f ms, round trip time: %.1f ms, throughput: %.1f KiB/s"),
+		job->connect_time / 1000.0, job->round_trip / 1000.0, throughput);
+	label = g_object_get_data(G_OBJECT(dialog), "timing_label");
+	gtk_label_set_text(GTK_LABEL(label), text);
+	gtk_widget_show(label);
+	g_free(text);
+
+	text = g_markup_printf_escaped("<tt>%s</tt>", job->reply->text->str);
+	label = g_object_get_data(G_OBJECT(dialog), "info_label");
+	gtk_label_set_markup(GTK_LABEL(label), text);
+	g_free(text);
+}
 
-	buffer++;
 
-	end = strstr(buffer, ".\r\n250");
-	*end = '\0';
+/* Shows the dialog right away and fills it when the server answered, closing the dialog
+ * cancels the query */
+void dict_dictd_get_information(GtkWidget *button, DictData *dd)
+{
+	ServerInfoJob *job;
+	GTask *task;
+	GCancellable *cancellable;
+	gchar *text;
+	GtkEntry *entry_server = g_object_get_data(G_OBJECT(button), "server_entry");
+	GtkSpinButton *entry_port = g_object_get_data(G_OBJECT(button), "port_spinner");
+	const gchar *server;
+	gint port;
+	GtkWidget *dialog, *label, *swin, *vbox, *progress_box, *spinner;
+
+	server = gtk_entry_get_text(entry_server);
+	port = gtk_spin_button_get_value_as_int(entry_port);
 
 	text = g_strdup_printf(_("Server Information for \"%s\""), server);
 	dialog = xfce_titled_dialog_new_with_mixed_buttons(text,
-				GTK_WINDOW(dd->window),
+				GTK_WINDOW(gtk_widget_get_toplevel(button)),
 				GTK_DIALOG_DESTROY_WITH_PARENT,
 				"window-close", _("_Close"), GTK_RESPONSE_CLOSE, NULL);
 	vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 12);
@@ -769,12 +841,28 @@ void dict_dictd_get_information(GtkWidget *button, DictData *dd)
 
 	gtk_window_set_default_size(GTK_WINDOW(dialog), 550, 400);
 	gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_CLOSE);
+	g_signal_connect(dialog, "response", G_CALLBACK(gtk_widget_destroy), NULL);
+
+	/* shown until the server answered */
+	progress_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+	spinner = gtk_spinner_new();
+	gtk_spinner_start(GTK_SPINNER(spinner));
+	gtk_box_pack_start(GTK_BOX(progress_box), spinner, FALSE, FALSE, 0);
+	text = g_strdup_printf(_("Querying %s..."), server);
+	gtk_box_pack_start(GTK_BOX(progress_box), gtk_label_new(text), FALSE, FALSE, 0);
+	g_free(text);
+	gtk_box_pack_start(GTK_BOX(vbox), progress_box, FALSE, FALSE, 0);
+	g_object_set_data(G_OBJECT(dialog), "progress_box", progress_box);
+
+	label = gtk_label_new(NULL);
+	gtk_label_set_selectable(GTK_LABEL(label), TRUE);
+	gtk_widget_set_halign(label, GTK_ALIGN_START);
+	gtk_box_pack_start(GTK_BOX(vbox), label, FALSE, FALSE, 0);
+	g_object_set_data(G_OBJECT(dialog), "timing_label", label);
 
-	text = g_strconcat("<tt>", buffer, "</tt>", NULL);
-	label = gtk_label_new(text);
-	gtk_label_set_use_markup(GTK_LABEL(label), TRUE);
+	label = gtk_label_new(NULL);
 	gtk_widget_set_vexpand(label, TRUE);
-	g_free(text);
+	g_object_set_data(G_OBJECT(dialog), "info_label", label);
 
 	swin = gtk_scrolled_window_new(NULL, NULL);
 	gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(swin),
@@ -784,100 +872,461 @@ void dict_dictd_get_information(GtkWidget *button, DictData *dd)
 	gtk_box_pack_start(GTK_BOX(vbox), swin, TRUE, TRUE, 0);
 
 	gtk_widget_show_all(vbox);
-	gtk_dialog_run(GTK_DIALOG(dialog));
-	gtk_widget_destroy(dialog);
+	gtk_widget_hide(g_object_get_data(G_OBJECT(dialog), "timing_label"));
+	gtk_widget_show(dialog);
+
+	job = g_new0(ServerInfoJob, 1);
+	job->dd = dd;
+	job->server = g_strdup(server);
+	job->port = port;
+
+	cancellable = g_cancellable_new();
+	g_object_set_data_full(G_OBJECT(dialog), "cancellable", cancellable, g_object_unref);
+	g_signal_connect_swapped(dialog, "destroy", G_CALLBACK(g_cancellable_cancel), cancellable);
+
+	task = g_task_new(dialog, cancellable, server_info_finished, NULL);
+	g_task_set_task_data(task, job, (GDestroyNotify) server_info_job_free);
+	g_task_run_in_thread(task, server_info_thread);
+	g_object_unref(task);
+}
+
 
-	g_free(answer);
+/* Returns the file the database list of the server is cached in */
+static gchar *database_cache_file(const gchar *server, gint port, gboolean create)
+{
+	gchar *name, *path;
+
+	name = g_strdup_printf("xfce4/xfce4-dict/databases/%s_%d", server, port);
+	/* keep the server part a single path component */
+	g_strdelimit(name + strlen("xfce4/xfce4-dict/databases/"), "/", '_');
+	path = xfce_resource_save_location(XFCE_RESOURCE_CACHE, name, create);
+	g_free(name);
+
+	return path;
 }
 
 
-void dict_dictd_get_list(GtkWidget *button, DictData *dd)
+static gboolean database_visible(GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+	GtkWidget *dict_combo = data;
+	GtkEntry *search_entry = g_object_get_data(G_OBJECT(dict_combo), "search_entry");
+	const gchar *active = g_object_get_data(G_OBJECT(dict_combo), "active_database");
+	const gchar *filter;
+	gchar *name, *text, *folded_text, *folded_filter;
+	gboolean visible;
+
+	filter = (search_entry != NULL) ? gtk_entry_get_text(search_entry) : NULL;
+	if (! NZV(filter))
+		return TRUE;
+
+	gtk_tree_model_get(model, iter, DB_COLUMN_TEXT, &text, DB_COLUMN_NAME, &name, -1);
+	/* the fixed entries and the selected database are always shown */
+	if (name == NULL || text == NULL || g_strcmp0(name, active) == 0 ||
+		name[0] == '*' || name[0] == '!' || name[0] == '-')
+		visible = TRUE;
+	else
+	{
+		folded_text = g_utf8_casefold(text, -1);
+		folded_filter = g_utf8_casefold(filter, -1);
+		visible = (strstr(folded_text, folded_filter) != NULL);
+		g_free(folded_text);
+		g_free(folded_filter);
+	}
+	g_free(text);
+	g_free(name);
+
+	return visible;
+}
+
+
+static void database_combo_changed(GtkComboBox *dict_combo, gpointer data)
 {
-	gint fd, i;
-	gint max_lines;
-	gchar *buffer = NULL;
-	gchar *answer = NULL;
+	GtkTreeIter iter;
+	gchar *name, *text;
+
+	if (gtk_combo_box_get_active_iter(dict_combo, &iter))
+	{
+		gtk_tree_model_get(gtk_combo_box_get_model(dict_combo), &iter,
+			DB_COLUMN_TEXT, &text, DB_COLUMN_NAME, &name, -1);
+		g_object_set_data_full(G_OBJECT(dict_combo), "active_database", name, g_free);
+		g_object_set_data_full(G_OBJECT(dict_combo), "active_text", text, g_free);
+	}
+}
+
+
+/* Replaces the entries of the combo box by the given databases, one per line as sent by
+ * the server. The new list is filled before it is set, which is a lot faster than adding
+ * thousands of entries one by one to a visible combo box. */
+static void database_list_set(GtkWidget *dict_combo, const gchar *databases)
+{
+	GtkListStore *store;
+	GtkTreeModel *filter;
+	GtkTreeIter iter, active_iter;
 	gchar **lines;
-	GtkWidget *dict_combo = g_object_get_data(G_OBJECT(button), "dict_combo");
-	GtkEntry *entry_server = g_object_get_data(G_OBJECT(button), "server_entry");
-	GtkSpinButton *entry_port = g_object_get_data(G_OBJECT(button), "port_spinner");
-	const gchar *server;
+	gchar *name;
+	const gchar *active = g_object_get_data(G_OBJECT(dict_combo), "active_database");
+	gboolean found = FALSE;
+	gint i;
+
+	store = gtk_list_store_new(DB_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING);
+	/* first three entries (*, ! and ----) should always exist */
+	gtk_list_store_insert_with_values(store, NULL, -1,
+		DB_COLUMN_TEXT, _("* (use all)"), DB_COLUMN_NAME, "*", -1);
+	gtk_list_store_insert_with_values(store, NULL, -1,
+		DB_COLUMN_TEXT, _("! (use all, stop after first match)"), DB_COLUMN_NAME, "!", -1);
+	gtk_list_store_insert_with_values(store, NULL, -1,
+		DB_COLUMN_TEXT, "----------------", DB_COLUMN_NAME, "-", -1);
+
+	lines = g_strsplit((databases != NULL) ? databases : "", "\n", -1);
+	for (i = 0; lines[i] != NULL; i++)
+	{
+		if (lines[i][0] == '\0')
+			continue;
+
+		name = dict_query_database_name(lines[i]);
+		gtk_list_store_insert_with_values(store, &iter, -1,
+			DB_COLUMN_TEXT, lines[i], DB_COLUMN_NAME, name, -1);
+		if (! found && g_strcmp0(name, active) == 0)
+		{
+			active_iter = iter;
+			found = TRUE;
+		}
+		g_free(name);
+	}
+	g_strfreev(lines);
+
+	if (NZV(active) && ! found)
+	{
+		if (active[0] == '*' || active[0] == '!')
+		{
+			gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(store), &active_iter, NULL,
+				(active[0] == '*') ? 0 : 1);
+		}
+		else
+		{
+			/* keep the current setting even if the server does not list it (anymore) */
+			gtk_list_store_insert_with_values(store, &active_iter, -1,
+				DB_COLUMN_TEXT, g_object_get_data(G_OBJECT(dict_combo), "active_text"),
+				DB_COLUMN_NAME, active, -1);
+		}
+		found = TRUE;
+	}
+
+	filter = gtk_tree_model_filter_new(GTK_TREE_MODEL(store), NULL);
+	gtk_tree_model_filter_set_visible_func(GTK_TREE_MODEL_FILTER(filter),
+		database_visible, dict_combo, NULL);
+	gtk_combo_box_set_model(GTK_COMBO_BOX(dict_combo), filter);
+
+	if (found && gtk_tree_model_filter_convert_child_iter_to_iter(
+			GTK_TREE_MODEL_FILTER(filter), &iter, &active_iter))
+		gtk_combo_box_set_active_iter(GTK_COMBO_BOX(dict_combo), &iter);
+	else
+		gtk_combo_box_set_active(GTK_COMBO_BOX(dict_combo), 0);
+
+	g_object_unref(filter);
+	g_object_unref(store);
+}
+
+
+typedef struct
+{
+	DictData *dd;
+	gchar *server;
 	gint port;
+	gboolean interactive;	/* report errors, otherwise it is a background refresh */
+	gint status;
+	gchar *databases;
+} DatabaseListJob;
 
-	dictd_init();
 
-	server = gtk_entry_get_text(entry_server);
-	port = gtk_spin_button_get_value_as_int(entry_port);
+static void database_list_job_free(DatabaseListJob *job)
+{
+	g_free(job->server);
+	g_free(job->databases);
+	g_free(job);
+}
+
 
-	if ((fd = open_socket(server, port)) == -1)
+static void database_list_thread(GTask *task, gpointer source, gpointer data,
+								 GCancellable *cancellable)
+{
+	DatabaseListJob *job = data;
+	DictConnection *conn;
+	DictReply *reply;
+	gchar *path;
+
+	if ((conn = dict_connection_open(job->server, job->port, &job->status)) == NULL)
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
+		g_task_return_boolean(task, FALSE);
 		return;
 	}
 
-	dd->query_status = NO_CONNECTION;
+	job->status = dict_connection_command(conn, "SHOW DATABASES", &reply);
+	dict_connection_close(conn);
+
+	if (job->status == NO_ERROR)
+	{
+		job->databases = g_strdup(reply->text->str);
+		path = database_cache_file(job->server, job->port, TRUE);
+		if (path != NULL)
+			g_file_set_contents(path, job->databases, -1, NULL);
+		g_free(path);
+	}
+	dict_reply_free(reply);
+
+	g_task_return_boolean(task, job->status == NO_ERROR);
+}
+
+
+static void database_list_finished(GObject *source, GAsyncResult *res, gpointer data)
+{
+	GtkWidget *dict_combo = GTK_WIDGET(source);
+	GtkWidget *button = data;
+	DatabaseListJob *job = g_task_get_task_data(G_TASK(res));
+	DictData *dd = job->dd;
+
+	if (button != NULL)
+	{
+		gtk_widget_set_sensitive(button, TRUE);
+		g_object_unref(button);
+	}
+	/* the preferences dialog was closed in the meantime */
+	if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(res))) ||
+		gtk_widget_get_toplevel(dict_combo) == dict_combo)
+		return;
 
-	dd->query_status = get_answer(fd, NULL);
-	if (dd->query_status != NO_ERROR)
+	if (job->status == NO_ERROR)
+		database_list_set(dict_combo, job->databases);
+	else if (! job->interactive)
 	{
+		if (dd->verbose_mode)
+			g_message("Could not refresh the database list of %s: %s",
+				job->server, dict_query_status_message(job->status));
+	}
+	else if (job->status == NO_CONNECTION)
 		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
+	else if (job->status == NO_DATABASES)
+		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("The server doesn't offer any databases."));
+	else
+		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Unknown error while querying the server."));
+}
+
+
+/* Fetches the database list in a worker thread, the combo box is updated when it is done */
+static void database_list_refresh(DictData *dd, GtkWidget *dict_combo, GtkWidget *button,
+								  const gchar *server, gint port)
+{
+	DatabaseListJob *job;
+	GTask *task;
+	GCancellable *cancellable = g_object_get_data(G_OBJECT(dict_combo), "cancellable");
+
+	job = g_new0(DatabaseListJob, 1);
+	job->dd = dd;
+	job->server = g_strdup(server);
+	job->port = port;
+	job->interactive = (button != NULL);
+
+	if (button != NULL)
+	{
+		gtk_widget_set_sensitive(button, FALSE);
+		g_object_ref(button);
+	}
+
+	task = g_task_new(dict_combo, cancellable, database_list_finished, button);
+	g_task_set_task_data(task, job, (GDestroyNotify) database_list_job_free);
+	g_task_run_in_thread(task, database_list_thread);
+	g_object_unref(task);
+}
+
+
+/* Fills the combo box with the cached database list of the configured server and refreshes
+ * the cache in the background if it is missing or outdated */
+void dict_dictd_init_database_list(DictData *dd, GtkWidget *dict_combo)
+{
+	GCancellable *cancellable;
+	GtkCellRenderer *renderer;
+	GStatBuf st;
+	gchar *path, *databases = NULL;
+	gboolean outdated = TRUE;
+
+	renderer = gtk_cell_renderer_text_new();
+	gtk_cell_layout_pack_start(GTK_CELL_LAYOUT(dict_combo), renderer, TRUE);
+	gtk_cell_layout_add_attribute(GTK_CELL_LAYOUT(dict_combo), renderer, "text", DB_COLUMN_TEXT);
+
+	g_object_set_data_full(G_OBJECT(dict_combo), "active_database",
+		dict_query_database_name(dd->dictionary), g_free);
+	g_object_set_data_full(G_OBJECT(dict_combo), "active_text",
+		g_strdup(NZV(dd->dictionary) ? dd->dictionary : "*"), g_free);
+	g_signal_connect(dict_combo, "changed", G_CALLBACK(database_combo_changed), NULL);
+
+	/* running refreshes are cancelled when the dialog is closed */
+	cancellable = g_cancellable_new();
+	g_object_set_data_full(G_OBJECT(dict_combo), "cancellable", cancellable, g_object_unref);
+	g_signal_connect_swapped(dict_combo, "destroy", G_CALLBACK(g_cancellable_cancel), cancellable);
+
+	if (NZV(dd->server))
+	{
+		path = database_cache_file(dd->server, dd->port, FALSE);
+		if (path != NULL && g_stat(path, &st) == 0 &&
+			g_file_get_contents(path, &databases, NULL, NULL))
+			outdated = (time(NULL) - st.st_mtime > DICT_DATABASE_CACHE_MAX_AGE);
+		g_free(path);
+	}
+
+	database_list_set(dict_combo, databases);
+	g_free(databases);
+
+	if (NZV(dd->server) && outdated)
+		database_list_refresh(dd, dict_combo, NULL, dd->server, dd->port);
+}
+
+
+/* Returns the selected entry of the database combo box, e.g. "wn "WordNet"" */
+gchar *dict_dictd_get_active_database(GtkWidget *dict_combo)
+{
+	GtkTreeIter iter;
+	gchar *text = NULL;
+
+	if (gtk_combo_box_get_active_iter(GTK_COMBO_BOX(dict_combo), &iter))
+		gtk_tree_model_get(gtk_combo_box_get_model(GTK_COMBO_BOX(dict_combo)), &iter,
+			DB_COLUMN_TEXT, &text, -1);
+
+	return text;
+}
+
+
+void dict_dictd_get_list(GtkWidget *button, DictData *dd)
+{
+	GtkWidget *dict_combo = g_object_get_data(G_OBJECT(button), "dict_combo");
+	GtkEntry *entry_server = g_object_get_data(G_OBJECT(button), "server_entry");
+	GtkSpinButton *entry_port = g_object_get_data(G_OBJECT(button), "port_spinner");
+
+	database_list_refresh(dd, dict_combo, button, gtk_entry_get_text(entry_server),
+		gtk_spin_button_get_value_as_int(entry_port));
+}
+
+
+typedef struct
+{
+	DictData *dd;
+	gchar *server;
+	gint port;
+	gint status;
+	gchar *strategies;	/* the answer to SHOW STRAT, one strategy per line */
+} StrategyListJob;
+
+
+static void strategy_list_job_free(StrategyListJob *job)
+{
+	g_free(job->server);
+	g_free(job->strategies);
+	g_free(job);
+}
+
+
+static void strategy_list_thread(GTask *task, gpointer source, gpointer data,
+								 GCancellable *cancellable)
+{
+	StrategyListJob *job = data;
+	DictConnection *conn;
+	DictReply *reply;
+
+	if ((conn = dict_connection_open(job->server, job->port, &job->status)) == NULL)
+	{
+		g_task_return_boolean(task, FALSE);
 		return;
 	}
 
-	send_command(fd, "SHOW DATABASES");
+	job->status = dict_connection_command(conn, "SHOW STRAT", &reply);
+	dict_connection_close(conn);
+
+	if (job->status == NO_ERROR)
+		job->strategies = g_strdup(reply->text->str);
+	dict_reply_free(reply);
 
-	/* read all server output */
-	dd->query_status = get_answer(fd, &answer);
-	buffer = answer;
-	send_command(fd, "QUIT");
-	get_answer(fd, NULL);
-	close(fd);
+	g_task_return_boolean(task, job->status == NO_ERROR);
+}
 
-	/* go to next line */
-	while (*buffer != '\n')
-		buffer++;
-	buffer++;
 
-	if (strncmp("554", buffer, 3) == 0)
+static void strategy_list_finished(GObject *source, GAsyncResult *res, gpointer data)
+{
+	GtkWidget *strategy_combo = GTK_WIDGET(source);
+	GtkWidget *button = data;
+	StrategyListJob *job = g_task_get_task_data(G_TASK(res));
+	DictData *dd = job->dd;
+	gchar **lines;
+	gint i;
+
+	gtk_widget_set_sensitive(button, TRUE);
+	g_object_unref(button);
+
+	/* the preferences dialog was closed in the meantime */
+	if (g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(res))) ||
+		gtk_widget_get_toplevel(strategy_combo) == strategy_combo)
+		return;
+
+	if (job->status == NO_CONNECTION)
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("The server doesn't offer any databases."));
+		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Could not connect to server."));
 		return;
 	}
-	else if (strncmp("110", buffer, 3) != 0 && strncmp("554", buffer, 3) != 0)
+	/* 555 (no strategies available) is reported as BAD_COMMAND */
+	if (job->status != NO_ERROR || ! NZV(job->strategies))
 	{
-		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("Unknown error while querying the server."));
+		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("The server doesn't offer any search strategies."));
 		return;
 	}
 
-	/* go to next line */
-	while (*buffer != '\n')
-		buffer++;
-	buffer++;
+	/* clear the combo box, the first entry (no strategy) should always exist */
+	i = gtk_tree_model_iter_n_children(gtk_combo_box_get_model(GTK_COMBO_BOX(strategy_combo)), NULL);
+	for (i -= 1; i > 0; i--)
+		gtk_combo_box_text_remove(GTK_COMBO_BOX_TEXT(strategy_combo), i);
 
-	/* clear the combo box */
-	i = gtk_tree_model_iter_n_children(gtk_combo_box_get_model(GTK_COMBO_BOX(dict_combo)), NULL);
-	for (i -= 1; i > 2; i--)  /* first three entries (*, ! and ----) should always exist */
+	/* one strategy per line, the name followed by a description */
+	lines = g_strsplit(job->strategies, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++)
 	{
-		gtk_combo_box_text_remove(GTK_COMBO_BOX_TEXT(dict_combo), i);
+		if (lines[i][0] != '\0')
+			gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(strategy_combo), lines[i]);
 	}
+	g_strfreev(lines);
+
+	gtk_combo_box_set_active(GTK_COMBO_BOX(strategy_combo), 0);
+}
 
-	/* parse output */
-	lines = g_strsplit(buffer, "\r\n", -1);
-	max_lines = g_strv_length(lines);
-	if (lines == NULL || max_lines == 0)
-		return;
 
-	i = 0;
-	while (i < max_lines && lines[i][0] != '.')
+/* Fetches the search strategies of the server in a worker thread like the database list,
+ * the combo box is filled when it is done */
+void dict_dictd_get_strategies(GtkWidget *button, DictData *dd)
+{
+	StrategyListJob *job;
+	GTask *task;
+	GCancellable *cancellable;
+	GtkWidget *strategy_combo = g_object_get_data(G_OBJECT(button), "strategy_combo");
+	GtkEntry *entry_server = g_object_get_data(G_OBJECT(button), "server_entry");
+	GtkSpinButton *entry_port = g_object_get_data(G_OBJECT(button), "port_spinner");
+
+	/* a running fetch is cancelled when the dialog is closed */
+	cancellable = g_object_get_data(G_OBJECT(strategy_combo), "cancellable");
+	if (cancellable == NULL)
 	{
-		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(dict_combo), lines[i]);
-		i++;
+		cancellable = g_cancellable_new();
+		g_object_set_data_full(G_OBJECT(strategy_combo), "cancellable", cancellable,
+			g_object_unref);
+		g_signal_connect_swapped(strategy_combo, "destroy", G_CALLBACK(g_cancellable_cancel),
+			cancellable);
 	}
 
-	g_strfreev(lines);
-	g_free(answer);
+	job = g_new0(StrategyListJob, 1);
+	job->dd = dd;
+	job->server = g_strdup(gtk_entry_get_text(entry_server));
+	job->port = gtk_spin_button_get_value_as_int(entry_port);
+
+	gtk_widget_set_sensitive(button, FALSE);
+	g_object_ref(button);
 
-	/* set the active entry to * because we don't know where the previously selected item now is in
-	 * the list and we also don't know whether it exists at all, and I don't walk through the list */
-	gtk_combo_box_set_active(GTK_COMBO_BOX(dict_combo), 0);
+	task = g_task_new(strategy_combo, cancellable, strategy_list_finished, button);
+	g_task_set_task_data(task, job, (GDestroyNotify) strategy_list_job_free);
+	g_task_run_in_thread(task, strategy_list_thread);
+	g_object_unref(task);
 }
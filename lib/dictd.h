@@ -21,8 +21,13 @@
 
 
 void dict_dictd_start_query(DictData *dd, const gchar *word);
+void dict_dictd_start_local_query(DictData *dd, const gchar *word);
+void dict_dictd_warm_up(DictData *dd);
+void dict_dictd_init_database_list(DictData *dd, GtkWidget *dict_combo);
+gchar *dict_dictd_get_active_database(GtkWidget *dict_combo);
 void dict_dictd_get_list(GtkWidget *button, DictData *dd);
 void dict_dictd_get_information(GtkWidget *button, DictData *dd);
+void dict_dictd_get_strategies(GtkWidget *button, DictData *dd);
 
 
 #endif
@@ -0,0 +1,486 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* Parser for the replies of a dictd server (RFC 2229). It only needs GLib, so it can be
+ * used and tested without any GUI and without a connection. The data is pushed into the
+ * parser in arbitrary chunks as it is received. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "arena.h"
+#include "dictparser.h"
+
+
+struct _DictParser
+{
+	DictReply *reply;
+	GString *line;			/* the incomplete line of the last chunk */
+	gint text_code;			/* the status code of the current text response or 0 */
+	DictDefinition *def;	/* the definition being read */
+	GString *def_text;
+	DictArena *arena;		/* temporary memory of the reply, freed with the parser */
+};
+
+
+DictParser *dict_parser_new(void)
+{
+	DictParser *parser = g_new0(DictParser, 1);
+
+	parser->reply = g_new0(DictReply, 1);
+	parser->reply->code = -1;
+	parser->reply->raw = g_string_sized_new(512);
+	parser->reply->definitions = g_ptr_array_new_with_free_func(
+		(GDestroyNotify) dict_definition_free);
+	parser->reply->matches = g_ptr_array_new_with_free_func((GDestroyNotify) dict_match_free);
+	parser->reply->text = g_string_new(NULL);
+	parser->line = g_string_sized_new(128);
+	parser->arena = dict_arena_new(0);
+
+	return parser;
+}
+
+
+/* Returns the status code of a status line or 0 if the line has none */
+static gint parser_reply_code(const gchar *line)
+{
+	if (g_ascii_isdigit(line[0]) && g_ascii_isdigit(line[1]) && g_ascii_isdigit(line[2]) &&
+		(line[3] == ' ' || line[3] == '\0'))
+	{
+		return (line[0] - '0') * 100 + (line[1] - '0') * 10 + (line[2] - '0');
+	}
+	return 0;
+}
+
+
+/* 151 "word" database "database description" */
+static void parser_start_definition(DictParser *parser, const gchar *line)
+{
+	gchar *parts[4] = { NULL, NULL, NULL, NULL };
+	gchar *pos;
+	guint n;
+
+	/* the line is split at the quotes in place, in a copy from the arena */
+	pos = dict_arena_strdup(parser->arena, line);
+	for (n = 0; n < G_N_ELEMENTS(parts) && pos != NULL; n++)
+	{
+		parts[n] = pos;
+		pos = strchr(pos, '"');
+		if (pos != NULL)
+			*pos++ = '\0';
+	}
+
+	parser->def = g_new0(DictDefinition, 1);
+	parser->def->word = g_strdup((n > 1) ? parts[1] : "");
+	parser->def->database = g_strdup((n > 2) ? g_strstrip(parts[2]) : "");
+	parser->def->description = g_strdup((n > 3) ? g_strstrip(parts[3]) : "");
+	parser->def_text = g_string_sized_new(512);
+}
+
+
+/* database "word" */
+static void parser_add_match(DictParser *parser, const gchar *line)
+{
+	DictMatch *match;
+	const gchar *word;
+	gsize len;
+
+	word = strchr(line, ' ');
+	if (word == NULL)
+		return;
+
+	match = g_new(DictMatch, 1);
+	match->database = g_strndup(line, word - line);
+
+	while (*word == ' ')
+		word++;
+	if (*word == '"')
+		word++;
+	len = strlen(word);
+	while (len > 0 && word[len - 1] == ' ')
+		len--;
+	if (len > 0 && word[len - 1] == '"')
+		len--;
+	match->word = g_strndup(word, len);
+
+	g_ptr_array_add(parser->reply->matches, match);
+}
+
+
+static void parser_process_line(DictParser *parser, const gchar *line)
+{
+	gint code;
+
+	if (parser->text_code != 0)
+	{
+		if (strcmp(line, ".") == 0)
+		{	/* end of the text response */
+			if (parser->def != NULL)
+			{
+				parser->def->definition = g_string_free(parser->def_text, FALSE);
+				g_ptr_array_add(parser->reply->definitions, parser->def);
+				parser->def = NULL;
+				parser->def_text = NULL;
+			}
+			parser->text_code = 0;
+			return;
+		}
+		/* a double period at line start is a masked period, cf. RFC 2229 */
+		if (line[0] == '.')
+			line++;
+
+		if (parser->text_code == 151)
+		{
+			g_string_append(parser->def_text, line);
+			g_string_append_c(parser->def_text, '\n');
+		}
+		else if (parser->text_code == 152)
+			parser_add_match(parser, line);
+		else
+		{
+			g_string_append(parser->reply->text, line);
+			g_string_append_c(parser->reply->text, '\n');
+		}
+		return;
+	}
+
+	code = parser_reply_code(line);
+	if (code >= 200)
+		parser->reply->code = code;
+	else if (code == 151)
+	{
+		parser_start_definition(parser, line);
+		parser->text_code = code;
+	}
+	else if ((code >= 110 && code <= 114) || code == 152)
+		parser->text_code = code;
+	/* anything else, e.g. "150 n definitions retrieved", carries no data */
+}
+
+
+/* Parses the next chunk of a reply. Parsing stops after the final status line, any data
+ * following it belongs to the next reply.
+ * Returns the number of bytes consumed. */
+gsize dict_parser_feed(DictParser *parser, const gchar *data, gsize len)
+{
+	const gchar *eol;
+	gsize pos = 0, n_line;
+
+	while (pos < len && parser->reply->code == -1)
+	{
+		eol = memchr(data + pos, '\n', len - pos);
+		if (eol == NULL)
+		{
+			g_string_append_len(parser->line, data + pos, len - pos);
+			g_string_append_len(parser->reply->raw, data + pos, len - pos);
+			return len;
+		}
+		n_line = eol - (data + pos);
+		g_string_append_len(parser->line, data + pos, n_line);
+		g_string_append_len(parser->reply->raw, data + pos, n_line + 1);
+		pos += n_line + 1;
+
+		if (parser->line->len > 0 && parser->line->str[parser->line->len - 1] == '\r')
+			g_string_truncate(parser->line, parser->line->len - 1);
+		parser_process_line(parser, parser->line->str);
+		g_string_truncate(parser->line, 0);
+	}
+	return pos;
+}
+
+
+/* Returns TRUE once the final status line has been parsed */
+gboolean dict_parser_is_complete(DictParser *parser)
+{
+	return parser->reply->code != -1;
+}
+
+
+/* Frees the parser and returns the parsed reply. The code of an incomplete reply is -1,
+ * a definition whose text was not terminated is dropped. */
+DictReply *dict_parser_finish(DictParser *parser)
+{
+	DictReply *reply;
+
+	/* the connection might have been closed without a final line terminator */
+	if (parser->reply->code == -1 && parser->line->len > 0)
+		parser_process_line(parser, parser->line->str);
+
+	if (parser->def != NULL)
+	{
+		g_string_free(parser->def_text, TRUE);
+		dict_definition_free(parser->def);
+	}
+	g_string_free(parser->line, TRUE);
+	dict_arena_free(parser->arena);
+	reply = parser->reply;
+	g_free(parser);
+
+	return reply;
+}
+
+
+/* Parses a complete reply, 'len' may be -1 if 'data' is NUL-terminated */
+DictReply *dict_parser_parse(const gchar *data, gssize len)
+{
+	DictParser *parser = dict_parser_new();
+
+	dict_parser_feed(parser, data, (len < 0) ? strlen(data) : (gsize) len);
+
+	return dict_parser_finish(parser);
+}
+
+
+void dict_reply_free(DictReply *reply)
+{
+	if (reply == NULL)
+		return;
+
+	g_string_free(reply->raw, TRUE);
+	g_string_free(reply->text, TRUE);
+	g_ptr_array_free(reply->definitions, TRUE);
+	g_ptr_array_free(reply->matches, TRUE);
+	g_free(reply);
+}
+
+
+void dict_definition_free(DictDefinition *def)
+{
+	g_free(def->word);
+	g_free(def->database);
+	g_free(def->description);
+	g_free(def->definition);
+	g_free(def);
+}
+
+
+DictDefinition *dict_definition_copy(const DictDefinition *def)
+{
+	DictDefinition *copy = g_new0(DictDefinition, 1);
+
+	copy->word = g_strdup(def->word);
+	copy->database = g_strdup(def->database);
+	copy->description = g_strdup(def->description);
+	copy->definition = g_strdup(def->definition);
+
+	return copy;
+}
+
+
+void dict_match_free(DictMatch *match)
+{
+	g_free(match->database);
+	g_free(match->word);
+	g_free(match);
+}
+
+
+static void add_span(GArray *spans, DictSpanType type, gsize start, gsize len)
+{
+	DictSpan span;
+
+	span.type = type;
+	span.start = start;
+	span.len = len;
+	g_array_append_val(spans, span);
+}
+
+
+static const gchar *phon_find_start(const gchar *buf, const gchar **start_str,
+									const gchar **end_str)
+{
+	const gchar *start;
+
+	/* we check only once for the various (\, / and [...]) formats for phonetic information
+	 * per line, for further occurrences on the same line we use the same format */
+	if (**start_str == '\0')
+	{
+		start = strchr(buf, '\\');
+		if (start != NULL)
+		{
+			*start_str = *end_str = "\\";
+		}
+		else
+		{
+			start = strchr(buf, '/');
+			if (start != NULL)
+			{
+				*start_str = *end_str = "/";
+			}
+			else
+			{
+				start = strchr(buf, '[');
+				if (start != NULL)
+				{
+					*start_str = "[";
+					*end_str = "]";
+				}
+			}
+		}
+	}
+	else
+	{
+		start = strchr(buf, **start_str);
+		if (start != NULL)
+		{
+			*start_str = *end_str = *start_str;
+		}
+	}
+
+	return start;
+}
+
+
+/* We parse the first line differently as there are usually no links
+ * but instead phonetic information.
+ * Returns the length of the parsed part of the header, the rest is parsed like the body. */
+static gsize markup_header(const gchar *header, GString *text, GArray *spans)
+{
+	const gchar *pos = header;
+	const gchar *start;
+	const gchar *end;
+	gchar end_char;
+	const gchar *start_str = "";
+	const gchar *end_str = "";
+
+	while (*pos != '\0')
+	{
+		start = phon_find_start(pos, &start_str, &end_str);
+		end_char = *end_str;
+
+		if (start == NULL)
+		{
+			/* no phonetics at all, so leave the text to the body to get at least possible
+			 * links parsed and return */
+			break;
+		}
+		g_string_append_len(text, pos, start - pos);
+		pos = start + 1; /* skip already handled text and the start char */
+
+		end = strchr(pos, end_char);
+		if (end == NULL)
+		{
+			/* start & end chars don't match, skip this part */
+			g_string_append_c(text, *start_str);
+			continue;
+		}
+
+		add_span(spans, DICT_SPAN_PHONETIC, text->len, end - pos);
+		g_string_append_len(text, pos, end - pos);
+		pos = end + 1; /* skip already handled text */
+	}
+	return pos - header;
+}
+
+
+/* ignore links like {n} or {f} as they are often found in translation dictionaries and
+ * used for giving additional type information but not intended to link or reference something */
+static gboolean ignore_short_link(const gchar *str, gsize len)
+{
+	static const gchar *ignored[] = { "f", "m", "n", "vr", "vt", "pl" };
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(ignored); i++)
+	{
+		if (strlen(ignored[i]) == len && strncmp(ignored[i], str, len) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+
+/* Find any cross-references like {reference} */
+static void markup_body(const gchar *body, GString *text, GArray *spans)
+{
+	const gchar *pos = body;
+	const gchar *start;
+	const gchar *end;
+	gsize len;
+
+	while (*pos != '\0')
+	{
+		start = strchr(pos, '{');
+		if (start == NULL)
+		{	/* no links at all, so add the text and go */
+			g_string_append(text, pos);
+			return;
+		}
+		g_string_append_len(text, pos, start - pos);
+		pos = start + 1;
+
+		end = strchr(pos, '}');
+		if (end == NULL)
+		{
+			/* braces don't match, skip this part, e.g. 'fd-deu-eng' returns
+			 * '    frozen}; to be cold; to freeze {froze' */
+			g_string_append_c(text, '{');
+			continue;
+		}
+		len = end - pos; /* length of the link */
+
+		if (ignore_short_link(pos, len))
+		{
+			g_string_append_c(text, '{');
+			g_string_append_len(text, pos, len);
+			g_string_append_c(text, '}');
+		}
+		else
+		{
+			add_span(spans, DICT_SPAN_LINK, text->len, len);
+			g_string_append_len(text, pos, len);
+		}
+		pos = end + 1;
+	}
+}
+
+
+/* Appends the display text of a definition to 'text' and DictSpan items for the phonetic
+ * information and the cross-references in it to 'spans'. The offsets of the spans are
+ * relative to the start of 'text'.
+ * The lines up to the first indented line are the header which usually contains the
+ * phonetics, the rest is the body which usually contains the cross-references.
+ * The temporary copy of the header is taken from 'arena' if it is not NULL. */
+void dict_parser_markup(const gchar *definition, GString *text, GArray *spans,
+						DictArena *arena)
+{
+	const gchar *line, *eol;
+	gchar *header;
+	gsize parsed;
+
+	for (line = definition; *line != '\0' && line[0] != ' '; line = eol)
+	{
+		eol = strchr(line, '\n');
+		eol = (eol != NULL) ? eol + 1 : line + strlen(line);
+	}
+
+	if (arena != NULL)
+		header = dict_arena_strndup(arena, definition, line - definition);
+	else
+		header = g_strndup(definition, line - definition);
+
+	/* the unparsed rest of the header is directly followed by the body */
+	parsed = markup_header(header, text, spans);
+	markup_body(definition + parsed, text, spans);
+
+	if (arena == NULL)
+		g_free(header);
+}
@@ -0,0 +1,84 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef DICTPARSER_H
+#define DICTPARSER_H 1
+
+#include <glib.h>
+
+#include "arena.h"
+
+
+typedef struct
+{
+	gchar *word;
+	gchar *database;
+	gchar *description;	/* the description of the database */
+	gchar *definition;	/* the text as sent by the server, masked periods are unmasked */
+} DictDefinition;
+
+typedef struct
+{
+	gchar *database;
+	gchar *word;
+} DictMatch;
+
+typedef struct _DictReply DictReply;
+
+struct _DictReply
+{
+	gint code;				/* the final status code or -1 if the reply is incomplete */
+	GString *raw;			/* the complete reply as received, with CRLF line ends */
+	GPtrArray *definitions;	/* DictDefinition items of 151 responses */
+	GPtrArray *matches;		/* DictMatch items of 152 responses */
+	GString *text;			/* the text of 110 to 114 responses */
+};
+
+typedef enum
+{
+	DICT_SPAN_PHONETIC,
+	DICT_SPAN_LINK
+} DictSpanType;
+
+/* a part of the display text of a definition, offsets are in bytes */
+typedef struct
+{
+	DictSpanType type;
+	guint start;
+	guint len;
+} DictSpan;
+
+typedef struct _DictParser DictParser;
+
+
+DictParser *dict_parser_new(void);
+gsize dict_parser_feed(DictParser *parser, const gchar *data, gsize len);
+gboolean dict_parser_is_complete(DictParser *parser);
+DictReply *dict_parser_finish(DictParser *parser);
+
+DictReply *dict_parser_parse(const gchar *data, gssize len);
+void dict_parser_markup(const gchar *definition, GString *text, GArray *spans,
+						DictArena *arena);
+
+void dict_reply_free(DictReply *reply);
+DictDefinition *dict_definition_copy(const DictDefinition *def);
+void dict_definition_free(DictDefinition *def);
+void dict_match_free(DictMatch *match);
+
+
+#endif
@@ -0,0 +1,268 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* Fuzzy matching of a word against a local list of headwords, e.g. a dictd .index file.
+ * The edit distance is computed with Myers' bit-parallel algorithm (in the variant for
+ * the distance of complete strings by Hyyrö), one machine word holds a whole column of
+ * the dynamic programming matrix, so a word is matched in a single pass over its bytes.
+ * Distances are counted in bytes and ASCII letters are compared case-insensitively. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "fuzzy.h"
+
+
+struct _DictHeadwords
+{
+	gchar *filename;
+	gchar *data;		/* the file contents, the headwords are NUL-terminated in place */
+	guint32 *offsets;	/* start of each headword in data, plus the end of the last one */
+	guint count;
+};
+
+typedef struct
+{
+	guint64 peq[256];	/* bit i is set in peq[c] if pattern[i] equals c */
+	guint64 high_bit;
+	guint len;
+} DictFuzzyPattern;
+
+typedef struct
+{
+	guint distance;
+	guint index;
+} DictFuzzyResult;
+
+
+/* Reads one headword per line. For dictd .index files only the part before the first tab
+ * is taken, empty lines are skipped. */
+DictHeadwords *dict_headwords_new_from_file(const gchar *filename, GError **error)
+{
+	DictHeadwords *headwords;
+	gchar *data, *line, *end, *next, *tab;
+	gsize len;
+	GArray *offsets;
+	guint32 pos = 0;
+
+	if (! g_file_get_contents(filename, &data, &len, error))
+		return NULL;
+	if (len >= G_MAXUINT32)
+	{
+		g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "%s is too large", filename);
+		g_free(data);
+		return NULL;
+	}
+
+	/* the headwords are compacted to the start of the buffer */
+	offsets = g_array_sized_new(FALSE, FALSE, sizeof(guint32), len / 16);
+	for (line = data; line < data + len; line = next)
+	{
+		end = memchr(line, '\n', data + len - line);
+		if (end == NULL)
+			end = data + len;
+		next = end + 1;
+
+		tab = memchr(line, '\t', end - line);
+		if (tab != NULL)
+			end = tab;
+		if (end > line && end[-1] == '\r')
+			end--;
+		if (end == line)
+			continue;
+
+		g_array_append_val(offsets, pos);
+		memmove(data + pos, line, end - line);
+		pos += end - line;
+		data[pos++] = '\0';
+	}
+	g_array_append_val(offsets, pos);
+
+	headwords = g_new0(DictHeadwords, 1);
+	headwords->filename = g_strdup(filename);
+	headwords->data = g_realloc(data, MAX(pos, 1));
+	headwords->count = offsets->len - 1;
+	headwords->offsets = (guint32 *) g_array_free(offsets, FALSE);
+
+	return headwords;
+}
+
+
+const gchar *dict_headwords_get_filename(DictHeadwords *headwords)
+{
+	return headwords->filename;
+}
+
+
+guint dict_headwords_get_count(DictHeadwords *headwords)
+{
+	return headwords->count;
+}
+
+
+void dict_headwords_free(DictHeadwords *headwords)
+{
+	if (headwords == NULL)
+		return;
+
+	g_free(headwords->filename);
+	g_free(headwords->data);
+	g_free(headwords->offsets);
+	g_free(headwords);
+}
+
+
+static gboolean fuzzy_pattern_init(DictFuzzyPattern *p, const gchar *pattern)
+{
+	guint i;
+	guchar c;
+
+	p->len = strlen(pattern);
+	if (p->len == 0 || p->len > DICT_FUZZY_MAX_PATTERN)
+		return FALSE;
+
+	memset(p->peq, 0, sizeof(p->peq));
+	for (i = 0; i < p->len; i++)
+	{
+		c = pattern[i];
+		p->peq[(guchar) g_ascii_tolower(c)] |= (guint64) 1 << i;
+		p->peq[(guchar) g_ascii_toupper(c)] |= (guint64) 1 << i;
+	}
+	p->high_bit = (guint64) 1 << (p->len - 1);
+
+	return TRUE;
+}
+
+
+/* Returns the edit distance between the pattern and the word or a value larger than
+ * max_distance as soon as it is certain that the distance is larger */
+static guint fuzzy_distance(const DictFuzzyPattern *p, const gchar *word, guint len,
+							guint max_distance)
+{
+	guint64 pv = ~(guint64) 0, mv = 0;
+	guint64 eq, xv, xh, ph, mh;
+	guint score = p->len;
+	guint i;
+
+	for (i = 0; i < len; i++)
+	{
+		eq = p->peq[(guchar) word[i]];
+		xv = eq | mv;
+		xh = (((eq & pv) + pv) ^ pv) | eq;
+		ph = mv | ~(xh | pv);
+		mh = pv & xh;
+
+		if (ph & p->high_bit)
+			score++;
+		else if (mh & p->high_bit)
+			score--;
+
+		/* each of the remaining bytes can lower the distance by at most one */
+		if (score > max_distance + (len - i - 1))
+			return max_distance + 1;
+
+		/* the first row of the matrix grows by one per column */
+		ph = (ph << 1) | 1;
+		mh <<= 1;
+		pv = mh | ~(xv | ph);
+		mv = ph & xv;
+	}
+	return score;
+}
+
+
+/* Returns the edit distance of two words, e.g. for ranking results from other sources */
+guint dict_fuzzy_distance(const gchar *pattern, const gchar *word)
+{
+	DictFuzzyPattern p;
+	guint len = strlen(word);
+
+	if (! fuzzy_pattern_init(&p, pattern))
+		return G_MAXUINT;
+
+	/* the distance is never larger than the longer of both */
+	return fuzzy_distance(&p, word, len, MAX(len, p.len));
+}
+
+
+static gint compare_results(gconstpointer a, gconstpointer b)
+{
+	const DictFuzzyResult *x = a;
+	const DictFuzzyResult *y = b;
+
+	if (x->distance != y->distance)
+		return (x->distance < y->distance) ? -1 : 1;
+	return (x->index > y->index) - (x->index < y->index);
+}
+
+
+/* Returns the headwords within max_distance edits of the pattern, the closest first and
+ * at most max_results of them. The array owns the returned strings. */
+GPtrArray *dict_headwords_fuzzy(DictHeadwords *headwords, const gchar *pattern,
+								guint max_distance, guint max_results)
+{
+	DictFuzzyPattern p;
+	DictFuzzyResult result;
+	GArray *results;
+	GPtrArray *words = g_ptr_array_new_with_free_func(g_free);
+	guint i, len, limit = max_distance;
+
+	if (! fuzzy_pattern_init(&p, pattern) || max_results == 0)
+		return words;
+
+	results = g_array_new(FALSE, FALSE, sizeof(DictFuzzyResult));
+	for (i = 0; i < headwords->count; i++)
+	{
+		len = headwords->offsets[i + 1] - headwords->offsets[i] - 1;
+		/* the distance is at least the difference of the lengths */
+		if (len + limit < p.len || len > p.len + limit)
+			continue;
+
+		result.distance = fuzzy_distance(&p, headwords->data + headwords->offsets[i], len, limit);
+		if (result.distance > limit)
+			continue;
+
+		result.index = i;
+		g_array_append_val(results, result);
+
+		/* keep only the best results once there are plenty and only look for words at
+		 * least as close as the worst of them from now on, which skips most of the words
+		 * after the length check */
+		if (results->len >= max_results * 4)
+		{
+			g_array_sort(results, compare_results);
+			g_array_set_size(results, max_results);
+			limit = g_array_index(results, DictFuzzyResult, max_results - 1).distance;
+		}
+	}
+
+	g_array_sort(results, compare_results);
+	for (i = 0; i < results->len && i < max_results; i++)
+	{
+		result = g_array_index(results, DictFuzzyResult, i);
+		g_ptr_array_add(words, g_strdup(headwords->data + headwords->offsets[result.index]));
+	}
+	g_array_free(results, TRUE);
+
+	return words;
+}
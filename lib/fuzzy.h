@@ -0,0 +1,42 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef FUZZY_H
+#define FUZZY_H 1
+
+#include <glib.h>
+
+
+/* longer patterns are never matched */
+#define DICT_FUZZY_MAX_PATTERN	64
+
+
+typedef struct _DictHeadwords DictHeadwords;
+
+
+DictHeadwords *dict_headwords_new_from_file(const gchar *filename, GError **error);
+const gchar *dict_headwords_get_filename(DictHeadwords *headwords);
+guint dict_headwords_get_count(DictHeadwords *headwords);
+GPtrArray *dict_headwords_fuzzy(DictHeadwords *headwords, const gchar *pattern,
+								guint max_distance, guint max_results);
+void dict_headwords_free(DictHeadwords *headwords);
+
+guint dict_fuzzy_distance(const gchar *pattern, const gchar *word);
+
+
+#endif
@@ -34,6 +34,8 @@
 #include "gui.h"
 #include "resources.h"
 #include "speedreader.h"
+#include "dictd.h"
+#include "history.h"
 
 
 
@@ -42,6 +44,9 @@ static GdkCursor *hand_cursor = NULL;
 static GdkCursor *regular_cursor = NULL;
 static gboolean entry_is_dirty = FALSE;
 
+/* the name of the text mark for the position of the last right click */
+#define MARK_CLICK "click"
+
 
 /* all textview_* functions are from the gtk-demo app to get links in the textview working */
 static gchar *textview_get_hyperlink_at_iter(GtkWidget *text_view, GtkTextIter *iter, DictData *dd)
@@ -396,6 +401,11 @@ static gboolean textview_button_press_cb(GtkTextView *view, GdkEventButton *even
 
 		gdk_window_set_cursor(event->window, regular_cursor);
 	}
+	/* the back and forward buttons of the mouse */
+	else if (event->button == 8)
+		gtk_button_clicked(GTK_BUTTON(dd->back_button));
+	else if (event->button == 9)
+		gtk_button_clicked(GTK_BUTTON(dd->forward_button));
 
 	return FALSE;
 }
@@ -493,25 +503,262 @@ void dict_gui_status_add(DictData *dd, const gchar *format, ...)
 	g_vsnprintf(string + 1, (sizeof string) - 1, format, args);
 	va_end(args);
 
-	gtk_statusbar_pop(GTK_STATUSBAR(dd->statusbar), 1);
-	gtk_statusbar_push(GTK_STATUSBAR(dd->statusbar), 1, string);
+	if (dd->statusbar != NULL)
+	{
+		gtk_statusbar_pop(GTK_STATUSBAR(dd->statusbar), 1);
+		gtk_statusbar_push(GTK_STATUSBAR(dd->statusbar), 1, string);
+	}
 	if (dd->verbose_mode)
 		g_message("%s", string);
 }
 
 
+typedef struct
+{
+	GtkTextBuffer *buffer;
+	GSList *tags;
+} BufferTags;
+
+
+static void collect_buffer_tags(GtkTextTag *tag, BufferTags *bt)
+{
+	if (g_object_get_data(G_OBJECT(tag), DICT_TAG_BUFFER) == bt->buffer)
+		bt->tags = g_slist_prepend(bt->tags, tag);
+}
+
+
+/* Drops a kept result including the link tags created for it in the shared tag table */
+static void results_buffer_free(GtkTextBuffer *buffer)
+{
+	GtkTextTagTable *table = gtk_text_buffer_get_tag_table(buffer);
+	BufferTags bt = { buffer, NULL };
+	GSList *node;
+
+	gtk_text_tag_table_foreach(table, (GtkTextTagTableForeach) collect_buffer_tags, &bt);
+	for (node = bt.tags; node != NULL; node = node->next)
+		gtk_text_tag_table_remove(table, node->data);
+	g_slist_free(bt.tags);
+
+	g_object_unref(buffer);
+}
+
+
+static void results_queue_clear(GQueue *queue)
+{
+	GtkTextBuffer *buffer;
+
+	while ((buffer = g_queue_pop_head(queue)) != NULL)
+		results_buffer_free(buffer);
+}
+
+
+static gint results_queue_chars(GQueue *queue)
+{
+	GList *node;
+	gint chars = 0;
+
+	for (node = queue->head; node != NULL; node = node->next)
+		chars += gtk_text_buffer_get_char_count(node->data);
+
+	return chars;
+}
+
+
+/* Drops the oldest results until the kept ones are within the limits */
+static void results_limit(DictData *dd)
+{
+	while (! g_queue_is_empty(&dd->results_back) &&
+		   (dd->results_back.length + dd->results_forward.length > DICT_RESULTS_MAX ||
+		    results_queue_chars(&dd->results_back) +
+				results_queue_chars(&dd->results_forward) > DICT_RESULTS_MAX_CHARS))
+	{
+		results_buffer_free(g_queue_pop_tail(&dd->results_back));
+	}
+}
+
+
+/* A new buffer for the results, all buffers share the tag table of the first one */
+static GtkTextBuffer *results_buffer_new(DictData *dd)
+{
+	GtkTextBuffer *buffer = gtk_text_buffer_new(gtk_text_buffer_get_tag_table(dd->main_textbuffer));
+	GtkTextIter start;
+
+	gtk_text_buffer_get_start_iter(buffer, &start);
+	gtk_text_buffer_create_mark(buffer, MARK_CLICK, &start, TRUE);
+
+	return buffer;
+}
+
+
+/* Removes the sections of a query from results which are no longer shown, so that late
+ * output of a backend can't find a place in them */
+static void results_sections_clear(GtkTextBuffer *buffer)
+{
+	const gchar *sections[] = { DICT_SECTION_DICTD, DICT_SECTION_LOCAL, DICT_SECTION_SPELL };
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(sections); i++)
+	{
+		if (gtk_text_buffer_get_mark(buffer, sections[i]) != NULL)
+			gtk_text_buffer_delete_mark_by_name(buffer, sections[i]);
+	}
+}
+
+
+/* Shows the given results in the main window, the text view takes over the reference */
+static void results_show(DictData *dd, GtkTextBuffer *buffer)
+{
+	gtk_text_view_set_buffer(GTK_TEXT_VIEW(dd->main_textview), buffer);
+	g_object_unref(buffer);
+
+	dd->main_textbuffer = buffer;
+	dd->mark_click = gtk_text_buffer_get_mark(buffer, MARK_CLICK);
+	gtk_text_buffer_get_end_iter(buffer, &dd->textiter);
+
+	gtk_widget_set_sensitive(dd->back_button, ! g_queue_is_empty(&dd->results_back));
+	gtk_widget_set_sensitive(dd->forward_button, ! g_queue_is_empty(&dd->results_forward));
+}
+
+
+/* Shows the next kept result of 'from' without querying again. The current results are
+ * kept in 'to' unless they are empty. */
+static void results_go(DictData *dd, GQueue *from, GQueue *to)
+{
+	const gchar *word;
+
+	/* wait for the server's answer to the current search, the output of the other
+	 * backends is dropped if it comes after going back or forward */
+	if (g_queue_is_empty(from) || dd->query_is_running)
+		return;
+
+	results_sections_clear(dd->main_textbuffer);
+	if (gtk_text_buffer_get_char_count(dd->main_textbuffer) > 0)
+		g_queue_push_head(to, g_object_ref(dd->main_textbuffer));
+	results_show(dd, g_queue_pop_head(from));
+	/* late output of the backends is not for these results */
+	dd->search_id++;
+
+	word = g_object_get_data(G_OBJECT(dd->main_textbuffer), "word");
+	g_free(dd->searched_word);
+	dd->searched_word = g_strdup((word != NULL) ? word : "");
+	gtk_entry_set_text(GTK_ENTRY(dd->main_entry), dd->searched_word);
+	dict_gui_status_add(dd, _("Ready"));
+}
+
+
+static void back_button_clicked_cb(GtkButton *button, DictData *dd)
+{
+	results_go(dd, &dd->results_back, &dd->results_forward);
+}
+
+
+static void forward_button_clicked_cb(GtkButton *button, DictData *dd)
+{
+	results_go(dd, &dd->results_forward, &dd->results_back);
+}
+
+
+/* Empties the results for a new search. Shown results are not deleted but kept for going
+ * back to them, the new ones go into a new buffer. */
 void dict_gui_clear_text_buffer(DictData *dd)
 {
-	GtkTextIter end_iter;
+	if (dd->main_textbuffer == NULL)
+		return;
 
-	gtk_text_buffer_get_start_iter(dd->main_textbuffer, &dd->textiter);
-	gtk_text_buffer_get_end_iter(dd->main_textbuffer, &end_iter);
-	gtk_text_buffer_delete(dd->main_textbuffer, &dd->textiter, &end_iter);
+	/* the backends still running for the previous search drop their output */
+	dd->search_id++;
+	results_sections_clear(dd->main_textbuffer);
+
+	if (gtk_text_buffer_get_char_count(dd->main_textbuffer) > 0)
+	{
+		/* like in a web browser, the results left by going back are dropped */
+		results_queue_clear(&dd->results_forward);
+		g_queue_push_head(&dd->results_back, g_object_ref(dd->main_textbuffer));
+		results_limit(dd);
+		results_show(dd, results_buffer_new(dd));
+	}
+	else
+		gtk_text_buffer_get_start_iter(dd->main_textbuffer, &dd->textiter);
+	/* the searched word is restored when going back to the results */
+	g_object_set_data_full(G_OBJECT(dd->main_textbuffer), "word",
+		g_strdup(dd->searched_word), g_free);
 
 	gtk_widget_grab_focus(dd->main_entry);
 }
 
 
+/* Splits the empty results into one section per backend, in a fixed order no matter
+ * which backend finishes first. Each section ends at a mark with right gravity, so the
+ * text inserted at it stays in front of the mark and the sections grow independently. */
+void dict_gui_sections_create(DictData *dd)
+{
+	GtkTextIter iter;
+
+	/* a newline between the marks keeps them from moving together */
+	gtk_text_buffer_get_start_iter(dd->main_textbuffer, &iter);
+	gtk_text_buffer_insert(dd->main_textbuffer, &iter, "\n\n", 2);
+
+	gtk_text_buffer_get_iter_at_offset(dd->main_textbuffer, &iter, 0);
+	gtk_text_buffer_create_mark(dd->main_textbuffer, DICT_SECTION_DICTD, &iter, FALSE);
+	gtk_text_buffer_get_iter_at_offset(dd->main_textbuffer, &iter, 1);
+	gtk_text_buffer_create_mark(dd->main_textbuffer, DICT_SECTION_LOCAL, &iter, FALSE);
+	gtk_text_buffer_get_iter_at_offset(dd->main_textbuffer, &iter, 2);
+	gtk_text_buffer_create_mark(dd->main_textbuffer, DICT_SECTION_SPELL, &iter, FALSE);
+
+	gtk_text_buffer_get_start_iter(dd->main_textbuffer, &dd->textiter);
+}
+
+
+/* Moves dd->textiter to the end of the given section.
+ * Returns FALSE and leaves the iter alone if the results are not split into sections. */
+gboolean dict_gui_section_get_iter(DictData *dd, const gchar *section)
+{
+	GtkTextMark *mark = gtk_text_buffer_get_mark(dd->main_textbuffer, section);
+
+	if (mark == NULL)
+		return FALSE;
+
+	gtk_text_buffer_get_iter_at_mark(dd->main_textbuffer, &dd->textiter, mark);
+	return TRUE;
+}
+
+
+static void history_combo_append(gpointer word, gpointer combo)
+{
+	gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(combo), word);
+}
+
+
+/* Adds the word to the search history and moves it to the top of the combo box */
+void dict_gui_history_add(DictData *dd, const gchar *word)
+{
+	GtkTreeModel *model = gtk_combo_box_get_model(GTK_COMBO_BOX(dd->main_combo));
+	gint column = gtk_combo_box_get_entry_text_column(GTK_COMBO_BOX(dd->main_combo));
+	GtkTreeIter iter;
+	gboolean valid, found = FALSE;
+	gchar *text;
+	gint i = 0, n;
+
+	dict_history_add(dd->history, word);
+
+	/* the combo box holds the same words as the history in the same order */
+	for (valid = gtk_tree_model_get_iter_first(model, &iter); valid && ! found;
+		 valid = gtk_tree_model_iter_next(model, &iter), i++)
+	{
+		gtk_tree_model_get(model, &iter, column, &text, -1);
+		found = (g_strcmp0(text, word) == 0);
+		g_free(text);
+	}
+	if (found)
+		gtk_combo_box_text_remove(GTK_COMBO_BOX_TEXT(dd->main_combo), i - 1);
+	gtk_combo_box_text_prepend_text(GTK_COMBO_BOX_TEXT(dd->main_combo), word);
+
+	n = gtk_tree_model_iter_n_children(model, NULL);
+	if (n > DICT_HISTORY_MAX_ENTRIES)
+		gtk_combo_box_text_remove(GTK_COMBO_BOX_TEXT(dd->main_combo), n - 1);
+}
+
+
 static void entry_activate_cb(GtkEntry *entry, DictData *dd)
 {
 	const gchar *entered_text = gtk_entry_get_text(GTK_ENTRY(dd->main_entry));
@@ -557,6 +804,15 @@ static void combo_changed_cb(GtkComboBox *combo, DictData *dd)
 static void entry_changed_cb(GtkEditable *editable, DictData *dd)
 {
 	entry_is_dirty = TRUE;
+	dict_dictd_warm_up(dd);
+}
+
+
+static gboolean entry_focus_in_cb(GtkWidget *entry, GdkEventFocus *event, DictData *dd)
+{
+	dict_dictd_warm_up(dd);
+
+	return FALSE;
 }
 
 
@@ -616,6 +872,7 @@ static void update_search_button(DictData *dd, GtkWidget *box)
 	switch (dd->mode_in_use)
 	{
 		case DICTMODE_DICT:
+		case DICTMODE_ALL:
 		{
 			image = gtk_image_new_from_icon_name("edit-find", GTK_ICON_SIZE_BUTTON);
 			break;
@@ -673,6 +930,17 @@ static void search_mode_spell_toggled(GtkToggleButton *togglebutton, DictData *d
 }
 
 
+static void search_mode_all_toggled(GtkToggleButton *togglebutton, DictData *dd)
+{
+	if (gtk_toggle_button_get_active(togglebutton))
+	{
+		dd->mode_in_use = DICTMODE_ALL;
+		gtk_widget_grab_focus(dd->main_entry);
+		update_search_button(dd, NULL);
+	}
+}
+
+
 static void speedreader_clicked_cb(GtkButton *button, DictData *dd)
 {
 	GtkWidget *dialog = xfd_speed_reader_new(GTK_WINDOW(dd->window), dd);
@@ -764,6 +1032,9 @@ G_GNUC_END_IGNORE_DEPRECATIONS
 
 void dict_gui_finalize(DictData *dd)
 {
+	results_queue_clear(&dd->results_back);
+	results_queue_clear(&dd->results_forward);
+
 	if (hand_cursor)
 		g_object_unref (hand_cursor);
 	if (regular_cursor)
@@ -801,11 +1072,29 @@ void dict_gui_create_main_window(DictData *dd)
 	gtk_container_set_border_width(GTK_CONTAINER(entry_box), 2);
 	gtk_box_pack_start(GTK_BOX(main_box), entry_box, FALSE, TRUE, 5);
 
+	/* going back and forward through the previous results */
+	dd->back_button = gtk_button_new_from_icon_name("go-previous", GTK_ICON_SIZE_BUTTON);
+	gtk_widget_set_tooltip_text(dd->back_button, _("Show the previous results (Alt+Left)"));
+	gtk_widget_set_sensitive(dd->back_button, FALSE);
+	gtk_widget_add_accelerator(dd->back_button, "clicked", accel_group, GDK_KEY_Left, GDK_MOD1_MASK, 0);
+	g_signal_connect(dd->back_button, "clicked", G_CALLBACK(back_button_clicked_cb), dd);
+	gtk_widget_show(dd->back_button);
+	gtk_box_pack_start(GTK_BOX(entry_box), dd->back_button, FALSE, FALSE, 0);
+
+	dd->forward_button = gtk_button_new_from_icon_name("go-next", GTK_ICON_SIZE_BUTTON);
+	gtk_widget_set_tooltip_text(dd->forward_button, _("Show the next results (Alt+Right)"));
+	gtk_widget_set_sensitive(dd->forward_button, FALSE);
+	gtk_widget_add_accelerator(dd->forward_button, "clicked", accel_group, GDK_KEY_Right, GDK_MOD1_MASK, 0);
+	g_signal_connect(dd->forward_button, "clicked", G_CALLBACK(forward_button_clicked_cb), dd);
+	gtk_widget_show(dd->forward_button);
+	gtk_box_pack_start(GTK_BOX(entry_box), dd->forward_button, FALSE, FALSE, 0);
+
 	label_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
 	gtk_widget_show(label_box);
 	gtk_box_pack_start(GTK_BOX(entry_box), label_box, TRUE, TRUE, 5);
 
 	dd->main_combo = gtk_combo_box_text_new_with_entry();
+	dict_history_foreach(dd->history, history_combo_append, dd->main_combo);
 	gtk_widget_show(dd->main_combo);
 	gtk_box_pack_start(GTK_BOX(label_box), dd->main_combo, TRUE, TRUE, 0);
 	g_signal_connect(dd->main_combo, "changed", G_CALLBACK(combo_changed_cb), dd);
@@ -815,6 +1104,7 @@ void dict_gui_create_main_window(DictData *dd)
 	gtk_entry_set_icon_from_icon_name(GTK_ENTRY(dd->main_entry), GTK_ENTRY_ICON_PRIMARY, "edit-find");
 	gtk_entry_set_icon_from_icon_name(GTK_ENTRY(dd->main_entry), GTK_ENTRY_ICON_SECONDARY, "edit-clear");
 	g_signal_connect(dd->main_entry, "changed", G_CALLBACK(entry_changed_cb), dd);
+	g_signal_connect(dd->main_entry, "focus-in-event", G_CALLBACK(entry_focus_in_cb), dd);
 	g_signal_connect(dd->main_entry, "activate", G_CALLBACK(entry_activate_cb), dd);
 	g_signal_connect(dd->main_entry, "icon-release", G_CALLBACK(entry_icon_release_cb), dd);
 	g_signal_connect(dd->main_entry, "button-press-event", G_CALLBACK(entry_button_press_cb), dd);
@@ -859,6 +1149,7 @@ void dict_gui_create_main_window(DictData *dd)
 	radio = gtk_radio_button_new_with_mnemonic(NULL, _("_Dictionary Server"));
 	gtk_widget_show(radio);
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radio), (dd->mode_in_use == DICTMODE_DICT));
+	g_object_set_data(G_OBJECT(radio), "type", GINT_TO_POINTER(DICTMODE_DICT));
 	g_signal_connect(radio, "toggled", G_CALLBACK(search_mode_dict_toggled), dd);
 	gtk_box_pack_start(GTK_BOX(method_chooser), radio, FALSE, FALSE, 6);
 
@@ -866,16 +1157,27 @@ void dict_gui_create_main_window(DictData *dd)
 	dd->radio_button_web = radio;
 	gtk_widget_set_sensitive(dd->radio_button_web, NZV(dd->web_url));
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radio), (dd->mode_in_use == DICTMODE_WEB));
+	g_object_set_data(G_OBJECT(radio), "type", GINT_TO_POINTER(DICTMODE_WEB));
 	g_signal_connect(radio, "toggled", G_CALLBACK(search_mode_web_toggled), dd);
 	gtk_widget_show(radio);
 	gtk_box_pack_start(GTK_BOX(method_chooser), radio, FALSE, FALSE, 6);
 
 	radio = gtk_radio_button_new_with_mnemonic_from_widget(GTK_RADIO_BUTTON(radio), _("_Spell Checker"));
 	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radio), (dd->mode_in_use == DICTMODE_SPELL));
+	g_object_set_data(G_OBJECT(radio), "type", GINT_TO_POINTER(DICTMODE_SPELL));
 	g_signal_connect(radio, "toggled", G_CALLBACK(search_mode_spell_toggled), dd);
 	gtk_widget_show(radio);
 	gtk_box_pack_start(GTK_BOX(method_chooser), radio, FALSE, FALSE, 6);
 
+	radio = gtk_radio_button_new_with_mnemonic_from_widget(GTK_RADIO_BUTTON(radio), _("_All"));
+	gtk_widget_set_tooltip_text(radio,
+		_("Search the dictionary server, the local headword list and the spell checker at once"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radio), (dd->mode_in_use == DICTMODE_ALL));
+	g_object_set_data(G_OBJECT(radio), "type", GINT_TO_POINTER(DICTMODE_ALL));
+	g_signal_connect(radio, "toggled", G_CALLBACK(search_mode_all_toggled), dd);
+	gtk_widget_show(radio);
+	gtk_box_pack_start(GTK_BOX(method_chooser), radio, FALSE, FALSE, 6);
+
 	/* results area */
 	scrolledwindow_results = gtk_scrolled_window_new(NULL, NULL);
 	gtk_widget_show(scrolledwindow_results);
@@ -938,7 +1240,7 @@ void dict_gui_create_main_window(DictData *dd)
 	{
 		GtkTextIter start;
 		gtk_text_buffer_get_bounds(dd->main_textbuffer, &start, &start);
-		dd->mark_click = gtk_text_buffer_create_mark(dd->main_textbuffer, NULL, &start, TRUE);
+		dd->mark_click = gtk_text_buffer_create_mark(dd->main_textbuffer, MARK_CLICK, &start, TRUE);
 
 		g_signal_connect(dd->main_textview, "button-press-event",
 			G_CALLBACK(textview_button_press_cb), dd);
@@ -977,8 +1279,44 @@ void dict_gui_create_main_window(DictData *dd)
 }
 
 
+/* Selects the search method of the main window as if the user had chosen it */
+void dict_gui_set_search_mode(DictData *dd, dict_mode_t mode)
+{
+	GSList *node;
+
+	if (dd->radio_button_web == NULL)
+	{
+		dd->mode_in_use = mode;
+		return;
+	}
+
+	for (node = gtk_radio_button_get_group(GTK_RADIO_BUTTON(dd->radio_button_web));
+		 node != NULL; node = node->next)
+	{
+		if (GPOINTER_TO_INT(g_object_get_data(G_OBJECT(node->data), "type")) == (gint) mode)
+			gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(node->data), TRUE);
+	}
+}
+
+
+/* Creates the main window unless it exists already */
+void dict_gui_ensure_main_window(DictData *dd)
+{
+	if (dd->window != NULL)
+		return;
+
+	dict_gui_create_main_window(dd);
+	if (dd->window_created != NULL)
+		dd->window_created(dd, dd->window_created_data);
+
+	dict_gui_status_add(dd, _("Ready"));
+}
+
+
 void dict_gui_show_main_window(DictData *dd)
 {
+	dict_gui_ensure_main_window(dd);
+
 	gtk_widget_show(dd->window);
 	gtk_window_deiconify(GTK_WINDOW(dd->window));
 	gtk_window_present(GTK_WINDOW(dd->window));
@@ -1014,6 +1352,9 @@ void dict_gui_about_dialog(GtkWidget *widget, DictData *dd)
 
 void dict_gui_query_geometry(DictData *dd)
 {
+	if (dd->window == NULL)
+		return;
+
 	gtk_window_get_position(GTK_WINDOW(dd->window),	&dd->geometry[0], &dd->geometry[1]);
 	gtk_window_get_size(GTK_WINDOW(dd->window),	&dd->geometry[2], &dd->geometry[3]);
 
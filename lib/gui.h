@@ -20,15 +20,35 @@
 #define GUI_H 1
 
 
+/* names of the text marks for the results of each backend in DICTMODE_ALL */
+#define DICT_SECTION_DICTD "section-dictd"
+#define DICT_SECTION_LOCAL "section-local"
+#define DICT_SECTION_SPELL "section-spell"
+
+/* the number of previous results kept for going back and forward and the limit of their
+ * total length in characters */
+#define DICT_RESULTS_MAX		20
+#define DICT_RESULTS_MAX_CHARS	1000000
+
+/* object data of the link tags, the GtkTextBuffer they were created for */
+#define DICT_TAG_BUFFER "buffer"
+
+
 void dict_gui_status_add(DictData *dd, const gchar *format, ...);
 void dict_gui_create_main_window(DictData *dd);
+void dict_gui_ensure_main_window(DictData *dd);
+void dict_gui_set_search_mode(DictData *dd, dict_mode_t mode);
 void dict_gui_about_dialog(GtkWidget *widget, DictData *dd);
 void dict_gui_clear_text_buffer(DictData *dd);
 void dict_gui_set_panel_entry_text(DictData *dd, const gchar *text);
+void dict_gui_history_add(DictData *dd, const gchar *word);
 void dict_gui_show_main_window(DictData *dd);
 void dict_gui_query_geometry(DictData *dd);
 void dict_gui_finalize(DictData *dd);
 
+void dict_gui_sections_create(DictData *dd);
+gboolean dict_gui_section_get_iter(DictData *dd, const gchar *section);
+
 void dict_gui_textview_apply_tag_to_word(GtkTextBuffer *buffer, const gchar *word,
 										 GtkTextIter *pos, const gchar *first_tag,
 										 ...) G_GNUC_NULL_TERMINATED;
@@ -0,0 +1,198 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+/* The searched words, the most recently searched first and each word only once. The words
+ * are kept in a log file with one word per line which is only appended to. A word
+ * searched again is appended again and replaces its earlier line when the file is read.
+ * The file is read when the history is used first and it is rewritten with only the
+ * kept words when it has grown too long. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "history.h"
+
+
+/* the log is rewritten when it has this many times more lines than words are kept */
+#define DICT_HISTORY_LOG_FACTOR		4
+
+
+struct _DictHistory
+{
+	gchar *filename;	/* may be NULL to keep the history only in memory */
+	gboolean loaded;
+	GHashTable *words;	/* word -> its node in 'mru' */
+	GQueue mru;			/* the words, the most recently searched first */
+	guint log_lines;	/* the number of lines in the file */
+};
+
+
+/* Nothing is read until the history is used */
+DictHistory *dict_history_new(const gchar *filename)
+{
+	DictHistory *history = g_new0(DictHistory, 1);
+
+	history->filename = g_strdup(filename);
+	history->words = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&history->mru);
+
+	return history;
+}
+
+
+/* Moves the word to the front, the least recently searched word is dropped if there are
+ * too many */
+static void history_touch(DictHistory *history, const gchar *word, gsize len)
+{
+	GList *node;
+	gchar *copy = g_strndup(word, len);
+
+	node = g_hash_table_lookup(history->words, copy);
+	if (node != NULL)
+	{
+		g_free(copy);
+		g_queue_unlink(&history->mru, node);
+		g_queue_push_head_link(&history->mru, node);
+		return;
+	}
+
+	g_queue_push_head(&history->mru, copy);
+	g_hash_table_insert(history->words, copy, history->mru.head);
+
+	if (history->mru.length > DICT_HISTORY_MAX_ENTRIES)
+	{
+		copy = g_queue_pop_tail(&history->mru);
+		g_hash_table_remove(history->words, copy);
+		g_free(copy);
+	}
+}
+
+
+static void history_load(DictHistory *history)
+{
+	gchar *data, *line, *end;
+	gsize len;
+
+	history->loaded = TRUE;
+	if (history->filename == NULL || ! g_file_get_contents(history->filename, &data, &len, NULL))
+		return;
+
+	/* the lines are replayed in the order the words were searched */
+	for (line = data; line < data + len; line = end + 1)
+	{
+		end = memchr(line, '\n', data + len - line);
+		if (end == NULL)
+			end = data + len;
+		history->log_lines++;
+		if (end > line && g_utf8_validate(line, end - line, NULL))
+			history_touch(history, line, end - line);
+	}
+	g_free(data);
+}
+
+
+/* Replaces the file with the kept words, the oldest first */
+static void history_compact(DictHistory *history)
+{
+	GString *str = g_string_sized_new(DICT_HISTORY_MAX_ENTRIES * 16);
+	GList *node;
+	guint lines = 0;
+
+	for (node = history->mru.tail; node != NULL; node = node->prev)
+	{
+		if (strpbrk(node->data, "\r\n") != NULL)
+			continue;
+		g_string_append(str, node->data);
+		g_string_append_c(str, '\n');
+		lines++;
+	}
+	if (g_file_set_contents(history->filename, str->str, str->len, NULL))
+		history->log_lines = lines;
+	g_string_free(str, TRUE);
+}
+
+
+static void history_append(DictHistory *history, const gchar *word)
+{
+	gchar *dir;
+	FILE *fp;
+
+	if (history->log_lines >= DICT_HISTORY_MAX_ENTRIES * DICT_HISTORY_LOG_FACTOR)
+	{
+		history_compact(history);
+		return;
+	}
+
+	dir = g_path_get_dirname(history->filename);
+	g_mkdir_with_parents(dir, 0700);
+	g_free(dir);
+
+	fp = g_fopen(history->filename, "a");
+	if (fp == NULL)
+		return;
+	fprintf(fp, "%s\n", word);
+	fclose(fp);
+	history->log_lines++;
+}
+
+
+void dict_history_add(DictHistory *history, const gchar *word)
+{
+	if (word == NULL || *word == '\0')
+		return;
+
+	if (! history->loaded)
+		history_load(history);
+
+	history_touch(history, word, strlen(word));
+
+	/* words spanning several lines, e.g. dropped text, are not kept across sessions */
+	if (history->filename != NULL && strpbrk(word, "\r\n") == NULL)
+		history_append(history, word);
+}
+
+
+/* Calls 'func' for each word, the most recently searched first */
+void dict_history_foreach(DictHistory *history, GFunc func, gpointer data)
+{
+	if (! history->loaded)
+		history_load(history);
+
+	g_queue_foreach(&history->mru, func, data);
+}
+
+
+void dict_history_free(DictHistory *history)
+{
+	if (history == NULL)
+		return;
+
+	g_queue_foreach(&history->mru, (GFunc) g_free, NULL);
+	g_queue_clear(&history->mru);
+	g_hash_table_destroy(history->words);
+	g_free(history->filename);
+	g_free(history);
+}
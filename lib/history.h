@@ -0,0 +1,39 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+#ifndef HISTORY_H
+#define HISTORY_H 1
+
+#include <glib.h>
+
+
+/* the number of searched words which are kept */
+#define DICT_HISTORY_MAX_ENTRIES	50
+
+
+typedef struct _DictHistory DictHistory;
+
+
+DictHistory *dict_history_new(const gchar *filename);
+void dict_history_add(DictHistory *history, const gchar *word);
+void dict_history_foreach(DictHistory *history, GFunc func, gpointer data);
+void dict_history_free(DictHistory *history);
+
+
+#endif
@@ -24,6 +24,14 @@
 #include "dictd.h"
 #include "prefs.h"
 #include "gui.h"
+#include "arena.h"
+#include "dictparser.h"
+#include "query.h"
+#include "stats.h"
+#include "fuzzy.h"
+#include "cache.h"
+#include "history.h"
+#include "scanpopup.h"
 #include "dbus.h"
 
 
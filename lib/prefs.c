@@ -31,6 +31,9 @@
 #include "prefs.h"
 #include "dictd.h"
 #include "spell.h"
+#include "scanpopup.h"
+#include "dictparser.h"
+#include "query.h"
 
 
 typedef struct
@@ -76,6 +79,20 @@ static void show_panel_entry_toggled(GtkToggleButton *tb, DictData *dd)
 }
 
 
+/* the port is not used for servers listening on a Unix domain socket */
+static void server_entry_changed(GtkEditable *entry, GtkWidget *port_spinner)
+{
+	gtk_widget_set_sensitive(port_spinner,
+		! g_str_has_prefix(gtk_entry_get_text(GTK_ENTRY(entry)), DICT_UNIX_SOCKET_PREFIX));
+}
+
+
+static void database_filter_changed(GtkSearchEntry *entry, GtkComboBox *dict_combo)
+{
+	gtk_tree_model_filter_refilter(GTK_TREE_MODEL_FILTER(gtk_combo_box_get_model(dict_combo)));
+}
+
+
 static void search_method_changed(GtkRadioButton *radiobutton, DictData *dd)
 {
 	if (! gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(radiobutton)))
@@ -88,11 +105,11 @@ static void search_method_changed(GtkRadioButton *radiobutton, DictData *dd)
 void dict_prefs_dialog_response(GtkWidget *dlg, gint response, DictData *dd)
 {
 	gchar *dictionary;
+	GtkWidget *strategy_combo;
 
 	/* check some values before actually saving the settings in case we need to return to
 	 * the dialog */
-	dictionary = gtk_combo_box_text_get_active_text(
-		GTK_COMBO_BOX_TEXT(g_object_get_data(G_OBJECT(dlg), "dict_combo")));
+	dictionary = dict_dictd_get_active_database(g_object_get_data(G_OBJECT(dlg), "dict_combo"));
 	if (! NZV(dictionary) || dictionary[0] == '-')
 	{
 		dict_show_msgbox(dd, GTK_MESSAGE_ERROR, _("You have chosen an invalid dictionary."));
@@ -114,11 +131,31 @@ void dict_prefs_dialog_response(GtkWidget *dlg, gint response, DictData *dd)
 	g_free(dd->dictionary);
 	dd->dictionary = dictionary;
 
+	dd->server_suggestions = gtk_toggle_button_get_active(
+		GTK_TOGGLE_BUTTON(g_object_get_data(G_OBJECT(dlg), "check_suggestions")));
+
+	/* the entries are "name" or "name "description"", the first one means no strategy */
+	g_free(dd->strategy);
+	strategy_combo = g_object_get_data(G_OBJECT(dlg), "strategy_combo");
+	dictionary = gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(strategy_combo));
+	if (gtk_combo_box_get_active(GTK_COMBO_BOX(strategy_combo)) > 0 && NZV(dictionary))
+		dd->strategy = g_strndup(dictionary, strcspn(dictionary, " "));
+	else
+		dd->strategy = g_strdup("");
+	g_free(dictionary);
+
+	g_free(dd->headword_file);
+	dd->headword_file = gtk_file_chooser_get_filename(
+		GTK_FILE_CHOOSER(g_object_get_data(G_OBJECT(dlg), "headword_chooser")));
+	if (dd->headword_file == NULL)
+		dd->headword_file = g_strdup("");
+
 	/* MODE WEB */
 	g_free(dd->web_url);
 	dd->web_url = g_strdup(gtk_entry_get_text(
 			GTK_ENTRY(g_object_get_data(G_OBJECT(dlg), "web_entry"))));
-	gtk_widget_set_sensitive(dd->radio_button_web, NZV(dd->web_url));
+	if (dd->radio_button_web != NULL)
+		gtk_widget_set_sensitive(dd->radio_button_web, NZV(dd->web_url));
 
 	/* MODE SPELL */
 	dictionary = gtk_combo_box_text_get_active_text(
@@ -134,17 +171,27 @@ void dict_prefs_dialog_response(GtkWidget *dlg, gint response, DictData *dd)
 			GTK_ENTRY(g_object_get_data(G_OBJECT(dlg), "spell_entry"))));
 
 	/* general settings */
+	dd->scan_selection = gtk_toggle_button_get_active(
+		GTK_TOGGLE_BUTTON(g_object_get_data(G_OBJECT(dlg), "check_scan_selection")));
+	dict_scan_popup_init(dd);
+
 	if (dd->is_plugin)
 	{
 		dd->show_panel_entry = gtk_toggle_button_get_active(
 					GTK_TOGGLE_BUTTON(g_object_get_data(G_OBJECT(dlg), "check_panel_entry")));
 		dd->panel_entry_size = gtk_spin_button_get_value_as_int(
 					GTK_SPIN_BUTTON(g_object_get_data(G_OBJECT(dlg), "panel_entry_size_spinner")));
+		dd->prebuild_window = gtk_toggle_button_get_active(
+					GTK_TOGGLE_BUTTON(g_object_get_data(G_OBJECT(dlg), "check_prebuild_window")));
+	}
+	/* the tags are created along with the main window */
+	if (dd->window != NULL)
+	{
+		g_object_set(G_OBJECT(dd->link_tag), "foreground-rgba", dd->color_link, NULL);
+		g_object_set(G_OBJECT(dd->phon_tag), "foreground-rgba", dd->color_phonetic, NULL);
+		g_object_set(G_OBJECT(dd->error_tag), "foreground-rgba", dd->color_incorrect, NULL);
+		g_object_set(G_OBJECT(dd->success_tag), "foreground-rgba", dd->color_correct, NULL);
 	}
-	g_object_set(G_OBJECT(dd->link_tag), "foreground-rgba", dd->color_link, NULL);
-	g_object_set(G_OBJECT(dd->phon_tag), "foreground-rgba", dd->color_phonetic, NULL);
-	g_object_set(G_OBJECT(dd->error_tag), "foreground-rgba", dd->color_incorrect, NULL);
-	g_object_set(G_OBJECT(dd->success_tag), "foreground-rgba", dd->color_correct, NULL);
 
 	/* save settings */
 	dict_write_rc_file(dd);
@@ -287,7 +334,7 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 #define PAGE_GENERAL
 	{
 		GtkWidget *radio_button, *label, *grid, *label4;
-		GtkWidget *color_link, *color_phon, *color_success, *color_error;
+		GtkWidget *color_link, *color_phon, *color_success, *color_error, *check_scan_selection;
 		GSList *search_method;
 
 		notebook_vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 2);
@@ -330,6 +377,15 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 		g_object_set_data(G_OBJECT(radio_button), "type", GINT_TO_POINTER(DICTMODE_SPELL));
 		g_signal_connect(radio_button, "toggled", G_CALLBACK(search_method_changed), dd);
 
+		radio_button = gtk_radio_button_new_with_label(search_method, _("All at once"));
+		search_method = gtk_radio_button_get_group(GTK_RADIO_BUTTON(radio_button));
+		if (dd->mode_default == DICTMODE_ALL)
+			gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(radio_button), TRUE);
+		gtk_widget_show(radio_button);
+		gtk_box_pack_start(GTK_BOX(inner_vbox), radio_button, FALSE, FALSE, 0);
+		g_object_set_data(G_OBJECT(radio_button), "type", GINT_TO_POINTER(DICTMODE_ALL));
+		g_signal_connect(radio_button, "toggled", G_CALLBACK(search_method_changed), dd);
+
 		radio_button = gtk_radio_button_new_with_label(search_method, _("Last used method"));
 		search_method = gtk_radio_button_get_group(GTK_RADIO_BUTTON(radio_button));
 		if (dd->mode_default == DICTMODE_LAST_USED)
@@ -393,11 +449,27 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 		gtk_widget_show_all(grid);
 		gtk_box_pack_start(GTK_BOX(inner_vbox), grid, FALSE, FALSE, 0);
 
+		label = gtk_label_new(_("<b>Selection:</b>"));
+		gtk_label_set_use_markup(GTK_LABEL(label), TRUE);
+		gtk_widget_set_valign(label, GTK_ALIGN_END);
+		gtk_widget_show(label);
+		gtk_box_pack_start(GTK_BOX(inner_vbox), label, FALSE, FALSE, 5);
+
+		check_scan_selection = gtk_check_button_new_with_label(
+			_("Show the definition of selected words in a popup"));
+		gtk_widget_set_tooltip_text(check_scan_selection,
+			_("Click on the popup to show all definitions in the main window"));
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_scan_selection), dd->scan_selection);
+		gtk_widget_show(check_scan_selection);
+		gtk_box_pack_start(GTK_BOX(inner_vbox), check_scan_selection, FALSE, FALSE, 0);
+		g_object_set_data(G_OBJECT(dialog), "check_scan_selection", check_scan_selection);
+
 
 		/* show panel entry check box */
 		if (dd->is_plugin)
 		{
 			GtkWidget *pe_hbox, *panel_entry_size_label, *panel_entry_size_spinner, *check_panel_entry;
+			GtkWidget *check_prebuild_window;
 
 			label = gtk_label_new(_("<b>Panel Text Field:</b>"));
 			gtk_label_set_use_markup(GTK_LABEL(label), TRUE);
@@ -436,6 +508,16 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 
 			/* init the sensitive widgets */
 			show_panel_entry_toggled(GTK_TOGGLE_BUTTON(check_panel_entry), dd);
+
+			check_prebuild_window = gtk_check_button_new_with_label(
+				_("Prepare the dictionary window in the background after login"));
+			gtk_widget_set_tooltip_text(check_prebuild_window,
+				_("Otherwise the window is created when it is opened first"));
+			gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_prebuild_window),
+				dd->prebuild_window);
+			gtk_widget_show(check_prebuild_window);
+			gtk_box_pack_start(GTK_BOX(inner_vbox), check_prebuild_window, FALSE, FALSE, 0);
+			g_object_set_data(G_OBJECT(dialog), "check_prebuild_window", check_prebuild_window);
 		}
 		gtk_box_pack_start(GTK_BOX(notebook_vbox), inner_vbox, TRUE, TRUE, 5);
 
@@ -447,7 +529,11 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 #define PAGE_DICTD
 	 {
 		GtkWidget *grid, *button_get_list, *button_get_info;
-		GtkWidget *server_entry, *port_spinner, *dict_combo;
+		GtkWidget *server_entry, *port_spinner, *dict_combo, *dict_search_entry, *check_suggestions;
+		GtkWidget *label_strategy, *strategy_combo, *button_get_strategies;
+		GtkWidget *label_headwords, *headword_chooser;
+		const gchar *strategies[] = { "prefix", "substring", "re", "lev", NULL };
+		gint i, active = 0;
 
 		notebook_vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 2);
 		gtk_widget_show(notebook_vbox);
@@ -473,30 +559,76 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 		port_spinner = gtk_spin_button_new_with_range(0.0, 65536.0, 1.0);
 		gtk_spin_button_set_value(GTK_SPIN_BUTTON(port_spinner), dd->port);
 
+		gtk_widget_set_tooltip_text(server_entry,
+			_("A host name or, for a local server, unix: followed by the path of its socket"));
+		g_signal_connect(server_entry, "changed", G_CALLBACK(server_entry_changed), port_spinner);
+		server_entry_changed(GTK_EDITABLE(server_entry), port_spinner);
+
 		/* dictionary */
 		label3 = gtk_label_new_with_mnemonic(_("Dictionary:"));
 
-		dict_combo = gtk_combo_box_text_new();
-		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(dict_combo), _("* (use all)"));
-		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(dict_combo),
-											_("! (use all, stop after first match)"));
-		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(dict_combo), "----------------");
-		if (dd->dictionary != NULL)
+		/* filled from the cached list of the server, see dict_dictd_init_database_list() */
+		dict_combo = gtk_combo_box_new();
+
+		dict_search_entry = gtk_search_entry_new();
+		gtk_entry_set_placeholder_text(GTK_ENTRY(dict_search_entry), _("Filter dictionaries"));
+		g_object_set_data(G_OBJECT(dict_combo), "search_entry", dict_search_entry);
+		g_signal_connect(dict_search_entry, "search-changed",
+			G_CALLBACK(database_filter_changed), dict_combo);
+
+		dict_dictd_init_database_list(dd, dict_combo);
+
+		/* similar words */
+		check_suggestions = gtk_check_button_new_with_mnemonic(
+			_("_Suggest similar words from the server if nothing was found"));
+		gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(check_suggestions), dd->server_suggestions);
+
+		/* search strategy, the server's list can be fetched with the refresh button */
+		label_strategy = gtk_label_new_with_mnemonic(_("Search _strategy:"));
+
+		strategy_combo = gtk_combo_box_text_new();
+		gtk_label_set_mnemonic_widget(GTK_LABEL(label_strategy), strategy_combo);
+		gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(strategy_combo),
+			_("None (exact word only)"));
+		for (i = 0; strategies[i] != NULL; i++)
+		{
+			gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(strategy_combo), strategies[i]);
+			if (g_strcmp0(dd->strategy, strategies[i]) == 0)
+				active = i + 1;
+		}
+		if (NZV(dd->strategy) && active == 0)
 		{
-			if (dd->dictionary[0] == '*')
-				gtk_combo_box_set_active(GTK_COMBO_BOX(dict_combo), 0);
-			else if (dd->dictionary[0] == '!')
-				gtk_combo_box_set_active(GTK_COMBO_BOX(dict_combo), 1);
-			else
-			{
-				gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(dict_combo), dd->dictionary);
-				gtk_combo_box_set_active(GTK_COMBO_BOX(dict_combo), 3);
-			}
+			gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(strategy_combo), dd->strategy);
+			active = i + 1;
 		}
+		gtk_combo_box_set_active(GTK_COMBO_BOX(strategy_combo), active);
+
+		button_get_strategies = gtk_button_new_from_icon_name("view-refresh", GTK_ICON_SIZE_BUTTON);
+		gtk_widget_show(button_get_strategies);
+		g_signal_connect(button_get_strategies, "clicked",
+			G_CALLBACK(dict_dictd_get_strategies), dd);
+		g_object_set_data(G_OBJECT(button_get_strategies), "strategy_combo", strategy_combo);
+		g_object_set_data(G_OBJECT(button_get_strategies), "port_spinner", port_spinner);
+		g_object_set_data(G_OBJECT(button_get_strategies), "server_entry", server_entry);
+
+		/* local headword list, e.g. a dictd .index file, for fuzzy matching */
+		label_headwords = gtk_label_new_with_mnemonic(_("Local _headword list:"));
+
+		headword_chooser = gtk_file_chooser_button_new(_("Select a headword list"),
+			GTK_FILE_CHOOSER_ACTION_OPEN);
+		gtk_label_set_mnemonic_widget(GTK_LABEL(label_headwords), headword_chooser);
+		if (NZV(dd->headword_file))
+			gtk_file_chooser_set_filename(GTK_FILE_CHOOSER(headword_chooser), dd->headword_file);
+		gtk_widget_set_tooltip_text(headword_chooser,
+			_("A file with one word per line or a dictd index file. It is used to find similar "
+			  "words and for the \"lev\" strategy without asking the server."));
 
 		g_object_set_data(G_OBJECT(dialog), "server_entry", server_entry);
 		g_object_set_data(G_OBJECT(dialog), "port_spinner", port_spinner);
 		g_object_set_data(G_OBJECT(dialog), "dict_combo", dict_combo);
+		g_object_set_data(G_OBJECT(dialog), "check_suggestions", check_suggestions);
+		g_object_set_data(G_OBJECT(dialog), "strategy_combo", strategy_combo);
+		g_object_set_data(G_OBJECT(dialog), "headword_chooser", headword_chooser);
 
 		button_get_list = gtk_button_new_from_icon_name("view-refresh", GTK_ICON_SIZE_BUTTON);
 		gtk_widget_show(button_get_list);
@@ -541,6 +673,26 @@ GtkWidget *dict_prefs_dialog_show(GtkWidget *parent, DictData *dd)
 
 		gtk_grid_attach(GTK_GRID(grid), button_get_list, 2, 2, 1, 1);
 
+		gtk_grid_attach(GTK_GRID(grid), dict_search_entry, 1, 3, 1, 1);
+
+		gtk_grid_attach(GTK_GRID(grid), label_strategy, 0, 4, 1, 1);
+		gtk_widget_set_valign (label_strategy, GTK_ALIGN_CENTER);
+		gtk_widget_set_halign (label_strategy, GTK_ALIGN_END);
+
+		gtk_grid_attach(GTK_GRID(grid), strategy_combo, 1, 4, 1, 1);
+		gtk_widget_set_hexpand(strategy_combo, TRUE);
+
+		gtk_grid_attach(GTK_GRID(grid), button_get_strategies, 2, 4, 1, 1);
+
+		gtk_grid_attach(GTK_GRID(grid), label_headwords, 0, 5, 1, 1);
+		gtk_widget_set_valign (label_headwords, GTK_ALIGN_CENTER);
+		gtk_widget_set_halign (label_headwords, GTK_ALIGN_END);
+
+		gtk_grid_attach(GTK_GRID(grid), headword_chooser, 1, 5, 1, 1);
+		gtk_widget_set_hexpand(headword_chooser, TRUE);
+
+		gtk_grid_attach(GTK_GRID(grid), check_suggestions, 0, 6, 3, 1);
+
 		gtk_widget_show_all(grid);
 		gtk_box_pack_start(GTK_BOX(inner_vbox), grid, FALSE, FALSE, 0);
 		gtk_box_pack_start(GTK_BOX(notebook_vbox), inner_vbox, TRUE, TRUE, 5);
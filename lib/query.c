@@ -0,0 +1,1575 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* The query core: talking to a dictd server (RFC 2229) and to the spell checker without
+ * any GUI interaction. Everything in here may be called from any thread, results are
+ * returned as plain structs and are rendered by the callers. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <netinet/in.h>
+#include <errno.h>
+#include <string.h>
+
+
+#include "dictparser.h"
+#include "query.h"
+#include "stats.h"
+#include "cache.h"
+
+
+#define BUF_SIZE 4096
+/* abort reading or writing after 10 seconds, there should went wrong something */
+#define DICT_CONNECTION_TIMEOUT 10
+
+/* idle connections kept per server and how long they may be idle, servers usually drop
+ * idle clients after a while */
+#define DICT_POOL_MAX_IDLE		4
+#define DICT_POOL_IDLE_TIMEOUT	(30 * G_USEC_PER_SEC)
+/* before that, connections idle for this many seconds are closed politely with QUIT, the
+ * pool is checked every few seconds while it is not empty */
+#define DICT_POOL_REAP_TIMEOUT	20
+#define DICT_POOL_REAP_INTERVAL	5
+
+/* limits for prefetching the cross-referenced words of a shown definition, at most that
+ * many words and received bytes per definition */
+#define DICT_PREFETCH_MAX_WORDS	8
+#define DICT_PREFETCH_MAX_BYTES	(64 * 1024)
+
+/* client-side limit for commands sent to public servers: bursts of up to DICT_RATE_BURST
+ * commands, afterwards DICT_RATE_PER_SECOND. After a 420 or 421 answer (server busy or
+ * shutting down) nothing is sent for a while, starting at one second and doubling with
+ * every further busy answer. */
+#define DICT_RATE_BURST			10
+#define DICT_RATE_PER_SECOND	5
+/* prefetching only uses the tokens above this many, the rest are kept for the searches of
+ * the user, enough for a search with all its pipelined commands */
+#define DICT_RATE_RESERVE		5
+#define DICT_BACKOFF_MIN		(1 * G_USEC_PER_SEC)
+#define DICT_BACKOFF_MAX		(60 * G_USEC_PER_SEC)
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+struct _DictConnection
+{
+	gint fd;
+	gchar *server;
+	gint port;
+	gboolean reused;	/* taken from the pool and not yet used successfully */
+	gboolean broken;	/* reading or writing failed, don't send anything anymore */
+	gint64 last_used;
+
+	gchar buf[BUF_SIZE];
+	gsize start;	/* start of the unread data in buf */
+	gsize len;		/* length of the unread data in buf */
+};
+
+struct _DictSpellSession
+{
+	GMutex lock;
+	GSubprocess *proc;
+	GOutputStream *input;
+	GDataInputStream *output;
+};
+
+
+typedef struct
+{
+	gchar *server;
+	gint port;
+	gchar *dictionary;
+	gchar **words;
+	guint generation;
+} PrefetchJob;
+
+
+typedef struct
+{
+	gchar *server;
+	gint port;
+} WarmUpJob;
+
+typedef struct
+{
+	gdouble tokens;
+	gint64 updated;
+	gint64 backoff;			/* the current backoff time, 0 if the server is not busy */
+	gint64 backoff_until;
+} RateLimit;
+
+/* a DEFINE request in progress, identical requests of other threads wait for its answer */
+typedef struct
+{
+	gint ref_count;
+	gboolean done;
+	gint status;
+	GPtrArray *definitions;	/* copies for the waiting threads */
+} Flight;
+
+
+/* idle connections, the most recently used first */
+static GQueue pool = G_QUEUE_INIT;
+/* the server to which a connection is being opened in advance, if any */
+static WarmUpJob *warm_up = NULL;
+static gint64 warm_up_failed = 0;
+static GCond warm_up_cond;
+static guint reaper_source = 0;
+G_LOCK_DEFINE_STATIC(pool);
+
+/* "server:port" -> RateLimit */
+static GHashTable *rate_limits = NULL;
+G_LOCK_DEFINE_STATIC(rate_limits);
+
+/* "server:port/database/word" -> Flight */
+static GHashTable *flights = NULL;
+static GCond flight_cond;
+G_LOCK_DEFINE_STATIC(flights);
+
+/* a single thread does all prefetching, one job after another */
+static GThreadPool *prefetch_pool = NULL;
+/* incremented for each new job, older jobs are stale then and stop early */
+static gint prefetch_generation = 0;
+G_LOCK_DEFINE_STATIC(prefetch);
+
+
+/* Connects to a local server listening on a Unix domain socket, which saves the TCP
+ * overhead */
+static gint open_unix_socket(const gchar *path)
+{
+	struct sockaddr_un addr;
+	struct timeval timeout = { DICT_CONNECTION_TIMEOUT, 0 };
+	gint fd;
+	gint64 start;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+		return -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	start = dict_stats_start();
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (gchar *) &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (gchar *) &timeout, sizeof(timeout));
+
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	dict_stats_end(DICT_STATS_CONNECT, start);
+
+	return fd;
+}
+
+
+/* The host name may also be "unix:" followed by the path of a socket, the port is
+ * ignored then */
+static gint open_socket(const gchar *host_name, gint port)
+{
+	struct addrinfo hints;
+	struct addrinfo *info, *ai;
+	struct timeval timeout = { DICT_CONNECTION_TIMEOUT, 0 };
+	gchar service[16];
+	gint fd = -1;
+	gint opt = 1;
+	gint64 start;
+
+	if (g_str_has_prefix(host_name, DICT_UNIX_SOCKET_PREFIX))
+		return open_unix_socket(host_name + strlen(DICT_UNIX_SOCKET_PREFIX));
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	g_snprintf(service, sizeof(service), "%d", port);
+
+	/* unlike gethostbyname(), getaddrinfo() is thread-safe */
+	start = dict_stats_start();
+	if (getaddrinfo(host_name, service, &hints, &info) != 0)
+		return -1;
+	dict_stats_end(DICT_STATS_RESOLVE, start);
+
+	start = dict_stats_start();
+
+	for (ai = info; ai != NULL; ai = ai->ai_next)
+	{
+		if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+			continue;
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (gchar *) &opt, sizeof(opt));
+		/* the timeouts replace the SIGALRM based timeout which didn't work with threads */
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (gchar *) &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, (gchar *) &timeout, sizeof(timeout));
+
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(info);
+	if (fd != -1)
+		dict_stats_end(DICT_STATS_CONNECT, start);
+
+	return fd;
+}
+
+
+static gint reply_status(gint code)
+{
+	switch (code)
+	{
+		case -1: /* connection closed or timed out */
+			return NO_CONNECTION;
+		case 420: /* server temporarily unavailable */
+		case 421: /* server shutting down */
+			return SERVER_NOT_READY;
+		case 550: /* invalid database */
+			return UNKNOWN_DATABASE;
+		case 552: /* no match */
+			return NOTHING_FOUND;
+		case 554: /* no databases present */
+			return NO_DATABASES;
+	}
+	return (code < 400) ? NO_ERROR : BAD_COMMAND;
+}
+
+
+/* Public servers are shared by many users, local ones are not limited */
+static gboolean server_is_local(const gchar *server)
+{
+	return g_str_has_prefix(server, DICT_UNIX_SOCKET_PREFIX) ||
+		g_str_equal(server, "localhost") || g_str_has_prefix(server, "127.") ||
+		g_str_equal(server, "::1");
+}
+
+
+/* Has to be called with the rate_limits lock held, returns NULL for local servers */
+static RateLimit *rate_limit_get(const gchar *server, gint port)
+{
+	RateLimit *limit;
+	gchar *key;
+
+	if (server_is_local(server))
+		return NULL;
+
+	if (rate_limits == NULL)
+		rate_limits = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+	key = g_strdup_printf("%s:%d", server, port);
+	if ((limit = g_hash_table_lookup(rate_limits, key)) == NULL)
+	{
+		limit = g_new0(RateLimit, 1);
+		limit->tokens = DICT_RATE_BURST;
+		limit->updated = g_get_monotonic_time();
+		g_hash_table_insert(rate_limits, key, limit);
+	}
+	else
+		g_free(key);
+
+	return limit;
+}
+
+
+/* Returns FALSE if the server asked us to wait before sending anything */
+static gboolean rate_limit_check(const gchar *server, gint port)
+{
+	RateLimit *limit;
+	gboolean allowed;
+
+	G_LOCK(rate_limits);
+	limit = rate_limit_get(server, port);
+	allowed = (limit == NULL || g_get_monotonic_time() >= limit->backoff_until);
+	G_UNLOCK(rate_limits);
+
+	return allowed;
+}
+
+
+/* Has to be called with the rate_limits lock held, adds the tokens earned since the
+ * last update */
+static void rate_limit_refill(RateLimit *limit, gint64 now)
+{
+	limit->tokens = MIN(DICT_RATE_BURST, limit->tokens +
+		(gdouble) (now - limit->updated) * DICT_RATE_PER_SECOND / G_USEC_PER_SEC);
+	limit->updated = now;
+}
+
+
+/* Returns TRUE if a command can be sent without waiting and without using the tokens kept
+ * for the searches of the user. Background work like prefetching stops otherwise. */
+static gboolean rate_limit_spare(const gchar *server, gint port)
+{
+	RateLimit *limit;
+	gint64 now;
+	gboolean spare = TRUE;
+
+	G_LOCK(rate_limits);
+	if ((limit = rate_limit_get(server, port)) != NULL)
+	{
+		now = g_get_monotonic_time();
+		rate_limit_refill(limit, now);
+		spare = (now >= limit->backoff_until && limit->tokens >= DICT_RATE_RESERVE + 1);
+	}
+	G_UNLOCK(rate_limits);
+
+	return spare;
+}
+
+
+/* Waits until 'n' commands may be sent to the server.
+ * Returns FALSE without waiting if the server asked us to wait. */
+static gboolean rate_limit_acquire(const gchar *server, gint port, guint n)
+{
+	RateLimit *limit;
+	gdouble needed = MIN(n, DICT_RATE_BURST);
+	gint64 now, wait;
+
+	while (TRUE)
+	{
+		G_LOCK(rate_limits);
+		if ((limit = rate_limit_get(server, port)) == NULL)
+		{
+			G_UNLOCK(rate_limits);
+			return TRUE;
+		}
+		now = g_get_monotonic_time();
+		if (now < limit->backoff_until)
+		{
+			G_UNLOCK(rate_limits);
+			return FALSE;
+		}
+
+		rate_limit_refill(limit, now);
+		if (limit->tokens >= needed)
+		{
+			/* larger pipelines than the bucket make the following commands wait longer */
+			limit->tokens -= n;
+			G_UNLOCK(rate_limits);
+			return TRUE;
+		}
+		wait = (gint64) ((needed - limit->tokens) * G_USEC_PER_SEC / DICT_RATE_PER_SECOND);
+		G_UNLOCK(rate_limits);
+
+		g_usleep(wait);
+	}
+}
+
+
+/* Starts or extends the backoff if the server is busy, resets it otherwise */
+static void rate_limit_report(const gchar *server, gint port, gint code)
+{
+	RateLimit *limit;
+
+	if (code == -1)
+		return;
+
+	G_LOCK(rate_limits);
+	if ((limit = rate_limit_get(server, port)) != NULL)
+	{
+		if (code == 420 || code == 421)
+		{
+			limit->backoff = (limit->backoff == 0) ?
+				DICT_BACKOFF_MIN : MIN(limit->backoff * 2, DICT_BACKOFF_MAX);
+			limit->backoff_until = g_get_monotonic_time() + limit->backoff;
+		}
+		else
+			limit->backoff = 0;
+	}
+	G_UNLOCK(rate_limits);
+}
+
+
+/* Reads a complete reply, i.e. all lines up to the final status line. Data received after
+ * it stays in the buffer for the next reply. If 'sent' is not 0, it is the time the
+ * command was sent and the timing of the reply is recorded.
+ * Returns the parsed reply, its code is -1 if the connection was closed or timed out. */
+static DictReply *connection_read_reply(DictConnection *conn, gint64 sent)
+{
+	DictParser *parser = dict_parser_new();
+	gssize n_read;
+	gsize n;
+	gint64 start, parse_time = 0;
+	gboolean first = TRUE;
+
+	while (TRUE)
+	{
+		if (conn->len > 0)
+		{
+			if (sent != 0 && first)
+			{
+				dict_stats_end(DICT_STATS_FIRST_BYTE, sent);
+				first = FALSE;
+			}
+			start = dict_stats_start();
+			n = dict_parser_feed(parser, conn->buf + conn->start, conn->len);
+			parse_time += g_get_monotonic_time() - start;
+			conn->start += n;
+			conn->len -= n;
+			if (dict_parser_is_complete(parser))
+				break;
+		}
+		conn->start = 0;
+
+		do
+			n_read = recv(conn->fd, conn->buf, sizeof(conn->buf), 0);
+		while (n_read < 0 && errno == EINTR);
+
+		if (n_read <= 0)
+			break;
+		conn->len = n_read;
+	}
+
+	if (sent != 0 && dict_parser_is_complete(parser))
+	{
+		dict_stats_end(DICT_STATS_LAST_BYTE, sent);
+		dict_stats_add(DICT_STATS_PARSE, parse_time);
+	}
+	return dict_parser_finish(parser);
+}
+
+
+/* Reads the greeting and returns only its status code */
+static gint connection_read_code(DictConnection *conn)
+{
+	DictReply *reply;
+	gint64 start = dict_stats_start();
+	gint code;
+
+	reply = connection_read_reply(conn, 0);
+	code = reply->code;
+	if (code != -1)
+		dict_stats_end(DICT_STATS_BANNER, start);
+
+	dict_reply_free(reply);
+	return code;
+}
+
+
+/* Connects to the server and reads its greeting. Returns NULL on failure and sets
+ * 'status' if not NULL. */
+DictConnection *dict_connection_open(const gchar *server, gint port, gint *status)
+{
+	DictConnection *conn;
+	gint fd, code, result;
+
+	if (! rate_limit_check(server, port))
+	{
+		if (status != NULL)
+			*status = SERVER_NOT_READY;
+		return NULL;
+	}
+	if ((fd = open_socket(server, port)) == -1)
+	{
+		if (status != NULL)
+			*status = NO_CONNECTION;
+		return NULL;
+	}
+
+	conn = g_new0(DictConnection, 1);
+	conn->fd = fd;
+	conn->server = g_strdup(server);
+	conn->port = port;
+
+	/* busy servers say so in their greeting */
+	code = connection_read_code(conn);
+	rate_limit_report(server, port, code);
+	result = reply_status(code);
+	if (status != NULL)
+		*status = result;
+	if (result != NO_ERROR)
+	{
+		close(fd);
+		g_free(conn->server);
+		g_free(conn);
+		return NULL;
+	}
+	return conn;
+}
+
+
+/* Returns a reply with the code -1 for commands which couldn't be sent */
+static DictReply *connection_no_reply(void)
+{
+	return dict_parser_finish(dict_parser_new());
+}
+
+
+/* Sends all commands at once and reads their replies into 'replies'. If the connection
+ * fails, the remaining replies are empty. */
+static void connection_send_commands(DictConnection *conn, const gchar * const *commands,
+									 DictReply **replies)
+{
+	GString *buf = g_string_sized_new(128);
+	gsize sent = 0;
+	gssize n;
+	gint64 start = dict_stats_start();
+	guint i;
+
+	for (i = 0; commands[i] != NULL; i++)
+	{
+		g_string_append(buf, commands[i]);
+		g_string_append(buf, "\r\n");
+	}
+
+	while (sent < buf->len)
+	{
+		n = send(conn->fd, buf->str + sent, buf->len - sent, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		sent += n;
+	}
+
+	if (sent == buf->len)
+	{
+		dict_stats_end(DICT_STATS_REQUEST, start);
+		start = g_get_monotonic_time();
+	}
+	for (i = 0; commands[i] != NULL; i++)
+	{
+		if (sent == buf->len && (i == 0 || replies[i - 1]->code != -1))
+			replies[i] = connection_read_reply(conn, start);
+		else
+			replies[i] = connection_no_reply();
+	}
+	g_string_free(buf, TRUE);
+}
+
+
+/* Sends the commands in a single round trip and stores the complete reply of each of
+ * them in 'replies', which has to be large enough for all of them. The replies have to
+ * be freed with dict_reply_free().
+ * Returns the query status (NO_ERROR, NOTHING_FOUND, ...) of the first command. */
+gint dict_connection_commands(DictConnection *conn, const gchar * const *commands,
+							  DictReply **replies)
+{
+	guint i, n_limited = 0, n_commands = g_strv_length((gchar **) commands);
+	gint fd, code;
+
+	if (conn->broken)
+	{
+		for (i = 0; i < n_commands; i++)
+			replies[i] = connection_no_reply();
+		return reply_status(-1);
+	}
+
+	/* saying goodbye is always allowed */
+	for (i = 0; i < n_commands; i++)
+	{
+		if (g_ascii_strcasecmp(commands[i], "QUIT") != 0)
+			n_limited++;
+	}
+	if (n_limited > 0 && ! rate_limit_acquire(conn->server, conn->port, n_limited))
+	{
+		for (i = 0; i < n_commands; i++)
+			replies[i] = connection_no_reply();
+		return SERVER_NOT_READY;
+	}
+
+	connection_send_commands(conn, commands, replies);
+	if (replies[0]->code == -1 && conn->reused)
+	{
+		/* the server dropped the pooled connection in the meantime, so try once again
+		 * with a new one */
+		close(conn->fd);
+		conn->start = conn->len = 0;
+		conn->reused = FALSE;
+		if ((fd = open_socket(conn->server, conn->port)) != -1)
+		{
+			conn->fd = fd;
+			if (reply_status(connection_read_code(conn)) == NO_ERROR)
+			{
+				for (i = 0; i < n_commands; i++)
+					dict_reply_free(replies[i]);
+				connection_send_commands(conn, commands, replies);
+			}
+		}
+		else
+			conn->fd = -1;
+	}
+
+	conn->reused = FALSE;
+	if (replies[n_commands - 1]->code == -1)
+		conn->broken = TRUE;
+
+	code = replies[0]->code;
+	for (i = 0; i < n_commands; i++)
+	{
+		if (replies[i]->code == 420 || replies[i]->code == 421)
+			code = replies[i]->code;
+	}
+	rate_limit_report(conn->server, conn->port, code);
+
+	return reply_status(replies[0]->code);
+}
+
+
+/* Sends the command and stores the complete reply in 'reply' if not NULL, it has to be
+ * freed with dict_reply_free().
+ * Returns the query status (NO_ERROR, NOTHING_FOUND, ...). */
+gint dict_connection_command(DictConnection *conn, const gchar *command, DictReply **reply)
+{
+	const gchar *commands[] = { command, NULL };
+	DictReply *result;
+	gint status;
+
+	status = dict_connection_commands(conn, commands, &result);
+	if (reply != NULL)
+		*reply = result;
+	else
+		dict_reply_free(result);
+
+	return status;
+}
+
+
+void dict_connection_close(DictConnection *conn)
+{
+	if (conn == NULL)
+		return;
+
+	if (! conn->broken)
+		dict_connection_command(conn, "QUIT", NULL);
+	if (conn->fd != -1)
+		close(conn->fd);
+	g_free(conn->server);
+	g_free(conn);
+}
+
+
+static gpointer close_connections_thread(gpointer data)
+{
+	g_slist_free_full(data, (GDestroyNotify) dict_connection_close);
+
+	return NULL;
+}
+
+
+/* Closes the connections which were idle for a while, before the server drops them */
+static gboolean pool_reap(gpointer data)
+{
+	DictConnection *item;
+	GList *node, *next;
+	GSList *expired = NULL;
+	gint64 now = g_get_monotonic_time();
+	gboolean keep;
+
+	G_LOCK(pool);
+	for (node = pool.head; node != NULL; node = next)
+	{
+		next = node->next;
+		item = node->data;
+		if (now - item->last_used >= DICT_POOL_REAP_TIMEOUT * G_USEC_PER_SEC)
+		{
+			g_queue_delete_link(&pool, node);
+			expired = g_slist_prepend(expired, item);
+		}
+	}
+	keep = (pool.length > 0);
+	if (! keep)
+		reaper_source = 0;
+	G_UNLOCK(pool);
+
+	/* sending QUIT and waiting for the answer takes a round trip */
+	if (expired != NULL)
+		g_thread_unref(g_thread_new(NULL, close_connections_thread, expired));
+
+	return keep;
+}
+
+
+/* Has to be called with the pool lock held */
+static void pool_push(DictConnection *conn)
+{
+	conn->last_used = g_get_monotonic_time();
+	g_queue_push_head(&pool, conn);
+
+	/* the reaper runs in the default main context, like everything else of the GUI */
+	if (reaper_source == 0)
+		reaper_source = g_timeout_add_seconds_full(G_PRIORITY_LOW, DICT_POOL_REAP_INTERVAL,
+			pool_reap, NULL, NULL);
+}
+
+
+/* Returns an idle connection to the server from the pool or opens a new one */
+DictConnection *dict_connection_pool_get(const gchar *server, gint port, gint *status)
+{
+	DictConnection *conn = NULL, *item;
+	GList *node, *next;
+	GSList *expired = NULL;
+	gint64 now = g_get_monotonic_time();
+
+	G_LOCK(pool);
+	/* a connection which is opened in advance is ready sooner than a new one */
+	while (warm_up != NULL && warm_up->port == port && g_strcmp0(warm_up->server, server) == 0)
+		g_cond_wait(&warm_up_cond, &G_LOCK_NAME(pool));
+
+	for (node = pool.head; node != NULL; node = next)
+	{
+		next = node->next;
+		item = node->data;
+		if (now - item->last_used > DICT_POOL_IDLE_TIMEOUT)
+		{
+			/* the server has probably dropped it already, so don't wait for an answer
+			 * to QUIT */
+			item->broken = TRUE;
+			g_queue_delete_link(&pool, node);
+			expired = g_slist_prepend(expired, item);
+		}
+		else if (conn == NULL && item->port == port && g_strcmp0(item->server, server) == 0)
+		{
+			g_queue_delete_link(&pool, node);
+			conn = item;
+		}
+	}
+	G_UNLOCK(pool);
+
+	g_slist_free_full(expired, (GDestroyNotify) dict_connection_close);
+
+	if (conn == NULL)
+		return dict_connection_open(server, port, status);
+
+	conn->reused = TRUE;
+	if (status != NULL)
+		*status = NO_ERROR;
+	return conn;
+}
+
+
+/* Puts the connection back into the pool for later use */
+void dict_connection_pool_put(DictConnection *conn)
+{
+	GList *node;
+	guint n_idle = 0;
+
+	if (conn == NULL)
+		return;
+
+	if (! conn->broken)
+	{
+		G_LOCK(pool);
+		for (node = pool.head; node != NULL; node = node->next)
+		{
+			DictConnection *item = node->data;
+
+			if (item->port == conn->port && g_strcmp0(item->server, conn->server) == 0)
+				n_idle++;
+		}
+		if (n_idle < DICT_POOL_MAX_IDLE)
+		{
+			pool_push(conn);
+			conn = NULL;
+		}
+		G_UNLOCK(pool);
+	}
+
+	dict_connection_close(conn);
+}
+
+
+static gpointer warm_up_thread(gpointer data)
+{
+	WarmUpJob *job = data;
+	DictConnection *conn;
+
+	conn = dict_connection_open(job->server, job->port, NULL);
+
+	G_LOCK(pool);
+	if (conn != NULL)
+		pool_push(conn);
+	else
+		warm_up_failed = g_get_monotonic_time();
+	warm_up = NULL;
+	g_cond_broadcast(&warm_up_cond);
+	G_UNLOCK(pool);
+
+	g_free(job->server);
+	g_free(job);
+
+	return NULL;
+}
+
+
+/* Opens a connection to the server in the background, so that the next lookup doesn't
+ * have to wait for the address lookup, the TCP handshake and the greeting. Nothing is done
+ * if there is an idle connection already. The connection is closed after a while if no
+ * lookup uses it. */
+void dict_connection_pool_warm_up(const gchar *server, gint port)
+{
+	DictConnection *item;
+	GList *node;
+	gboolean needed;
+	gint64 now = g_get_monotonic_time();
+
+	if (! NZV(server))
+		return;
+
+	G_LOCK(pool);
+	/* don't try again and again if the server can't be reached */
+	needed = (warm_up == NULL &&
+		now - warm_up_failed >= DICT_POOL_REAP_TIMEOUT * G_USEC_PER_SEC);
+	for (node = pool.head; node != NULL && needed; node = node->next)
+	{
+		item = node->data;
+		if (item->port == port && g_strcmp0(item->server, server) == 0 &&
+			now - item->last_used < DICT_POOL_REAP_TIMEOUT * G_USEC_PER_SEC)
+			needed = FALSE;
+	}
+	if (needed)
+	{
+		warm_up = g_new0(WarmUpJob, 1);
+		warm_up->server = g_strdup(server);
+		warm_up->port = port;
+		g_thread_unref(g_thread_new(NULL, warm_up_thread, warm_up));
+	}
+	G_UNLOCK(pool);
+}
+
+
+/* Closes all idle connections */
+void dict_connection_pool_clear(void)
+{
+	DictConnection *conn;
+
+	while (TRUE)
+	{
+		G_LOCK(pool);
+		conn = g_queue_pop_head(&pool);
+		G_UNLOCK(pool);
+
+		if (conn == NULL)
+			break;
+		dict_connection_close(conn);
+	}
+}
+
+
+/* Returns a copy of the word which is safe to be quoted in a command */
+gchar *dict_query_quote_word(const gchar *word)
+{
+	gchar *result = g_strdup(word);
+
+	g_strdelimit(result, "\"\r\n", ' ');
+
+	return result;
+}
+
+
+/* Returns the database name from a dictionary setting like "wn (WordNet)" */
+gchar *dict_query_database_name(const gchar *dictionary)
+{
+	const gchar *end;
+
+	if (! NZV(dictionary))
+		return g_strdup("*");
+
+	end = strchr(dictionary, ' ');
+	return (end != NULL) ? g_strndup(dictionary, end - dictionary) : g_strdup(dictionary);
+}
+
+
+/* Moves all items of 'from' to the end of 'to' */
+static void move_items(GPtrArray *from, GPtrArray *to)
+{
+	guint i;
+
+	for (i = 0; i < from->len; i++)
+		g_ptr_array_add(to, g_ptr_array_index(from, i));
+
+	g_ptr_array_set_free_func(from, NULL);
+	g_ptr_array_set_size(from, 0);
+}
+
+
+/* Returns a message for a query status, e.g. for reporting errors to D-Bus callers */
+const gchar *dict_query_status_message(gint status)
+{
+	switch (status)
+	{
+		case NO_ERROR:
+			return _("Ready");
+		case NO_CONNECTION:
+			return _("Could not connect to server.");
+		case SERVER_NOT_READY:
+			return _("The server is not ready.");
+		case UNKNOWN_DATABASE:
+			return _("Invalid dictionary specified. Please check your preferences.");
+		case NO_DATABASES:
+			return _("The server doesn't offer any databases.");
+		default:
+			return _("Unknown error while querying the server.");
+	}
+}
+
+
+static gchar *flight_key(const gchar *server, gint port, const gchar *database,
+						 const gchar *word)
+{
+	return g_strdup_printf("%s:%d/%s/%s", server, port, database, word);
+}
+
+
+/* Has to be called with the flights lock held */
+static void flight_unref(Flight *flight)
+{
+	if (--flight->ref_count > 0)
+		return;
+
+	if (flight->definitions != NULL)
+		g_ptr_array_free(flight->definitions, TRUE);
+	g_free(flight);
+}
+
+
+static void copy_definitions(GPtrArray *from, GPtrArray *to)
+{
+	guint i;
+
+	for (i = 0; i < from->len; i++)
+		g_ptr_array_add(to, dict_definition_copy(g_ptr_array_index(from, i)));
+}
+
+
+/* Sends DEFINE for the word and stores the found definitions in the cache and, if not
+ * NULL, appends them to 'definitions'. If the same request is already running in another
+ * thread, e.g. for a double click on a link, its answer is used instead. The connection
+ * is taken from the pool when it is needed first. 'received' is increased by the size of
+ * the reply if not NULL.
+ * Returns the query status. */
+static gint define_word(DictConnection **conn, const gchar *server, gint port,
+						const gchar *database, const gchar *word, GPtrArray *definitions,
+						gsize *received)
+{
+	Flight *flight;
+	DictReply *reply;
+	gchar *key, *quoted, *cmd;
+	gint status = NO_CONNECTION;
+
+	key = flight_key(server, port, database, word);
+
+	G_LOCK(flights);
+	if (flights == NULL)
+		flights = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	if ((flight = g_hash_table_lookup(flights, key)) != NULL)
+	{
+		flight->ref_count++;
+		while (! flight->done)
+			g_cond_wait(&flight_cond, &G_LOCK_NAME(flights));
+
+		status = flight->status;
+		if (definitions != NULL && flight->definitions != NULL)
+			copy_definitions(flight->definitions, definitions);
+		flight_unref(flight);
+		G_UNLOCK(flights);
+
+		g_free(key);
+		return status;
+	}
+	flight = g_new0(Flight, 1);
+	flight->ref_count = 1;
+	g_hash_table_insert(flights, g_strdup(key), flight);
+	G_UNLOCK(flights);
+
+	reply = NULL;
+	if (*conn == NULL)
+		*conn = dict_connection_pool_get(server, port, &status);
+	if (*conn != NULL)
+	{
+		quoted = dict_query_quote_word(word);
+		cmd = g_strdup_printf("DEFINE %s \"%s\"", database, quoted);
+		status = dict_connection_command(*conn, cmd, &reply);
+		g_free(cmd);
+		g_free(quoted);
+
+		if (status == NO_ERROR)
+			dict_cache_insert(server, port, database, word, reply->definitions);
+		if (received != NULL)
+			*received += reply->raw->len;
+	}
+
+	/* no other thread can join the request after it was removed from the table */
+	G_LOCK(flights);
+	g_hash_table_remove(flights, key);
+	flight->done = TRUE;
+	flight->status = status;
+	if (status == NO_ERROR && flight->ref_count > 1)
+	{
+		flight->definitions = g_ptr_array_new_with_free_func(
+			(GDestroyNotify) dict_definition_free);
+		copy_definitions(reply->definitions, flight->definitions);
+	}
+	g_cond_broadcast(&flight_cond);
+	flight_unref(flight);
+	G_UNLOCK(flights);
+
+	if (definitions != NULL && status == NO_ERROR)
+		move_items(reply->definitions, definitions);
+	dict_reply_free(reply);
+	g_free(key);
+
+	return status;
+}
+
+
+/* Waits until a DEFINE for the word which another thread sent through define_word() is
+ * answered, its definitions are in the cache then. Returns immediately if there is none. */
+void dict_query_join_define(const gchar *server, gint port, const gchar *database,
+							const gchar *word)
+{
+	Flight *flight;
+	gchar *key = flight_key(server, port, database, word);
+
+	G_LOCK(flights);
+	if (flights != NULL && (flight = g_hash_table_lookup(flights, key)) != NULL)
+	{
+		flight->ref_count++;
+		while (! flight->done)
+			g_cond_wait(&flight_cond, &G_LOCK_NAME(flights));
+		flight_unref(flight);
+	}
+	G_UNLOCK(flights);
+	g_free(key);
+}
+
+
+/* Looks up all words using a single connection, cached words are taken from the
+ * definition cache. The found definitions are appended to 'definitions' as DictDefinition
+ * items, words without a definition are skipped.
+ * Returns NO_ERROR or the status which stopped the lookups. */
+gint dict_query_define(const gchar *server, gint port, const gchar *dictionary,
+					   const gchar * const *words, GPtrArray *definitions)
+{
+	DictConnection *conn = NULL;
+	gint status = NO_ERROR;
+	guint i;
+	gchar *database;
+	GPtrArray *cached;
+
+	database = dict_query_database_name(dictionary);
+	for (i = 0; words[i] != NULL && status == NO_ERROR; i++)
+	{
+		if (! NZV(words[i]))
+			continue;
+
+		if ((cached = dict_cache_lookup(server, port, database, words[i])) != NULL)
+		{
+			move_items(cached, definitions);
+			g_ptr_array_free(cached, TRUE);
+			continue;
+		}
+
+		status = define_word(&conn, server, port, database, words[i], definitions, NULL);
+		if (status == NOTHING_FOUND)
+			status = NO_ERROR;
+	}
+	dict_connection_pool_put(conn);
+	g_free(database);
+
+	return status;
+}
+
+
+/* Searches the headwords matching 'word' using the given strategy, e.g. "prefix". The
+ * matches are appended to 'matches' as DictMatch items. */
+gint dict_query_match(const gchar *server, gint port, const gchar *dictionary,
+					  const gchar *strategy, const gchar *word, GPtrArray *matches)
+{
+	DictConnection *conn;
+	gint status;
+	gchar *database, *quoted, *cmd;
+	DictReply *reply;
+
+	if ((conn = dict_connection_pool_get(server, port, &status)) == NULL)
+		return status;
+
+	database = dict_query_database_name(dictionary);
+	quoted = dict_query_quote_word(word);
+	cmd = g_strdup_printf("MATCH %s %s \"%s\"", database, strategy, quoted);
+
+	status = dict_connection_command(conn, cmd, &reply);
+	if (status == NO_ERROR)
+		move_items(reply->matches, matches);
+	else if (status == NOTHING_FOUND)
+		status = NO_ERROR;
+
+	dict_connection_pool_put(conn);
+	dict_reply_free(reply);
+	g_free(cmd);
+	g_free(quoted);
+	g_free(database);
+
+	return status;
+}
+
+
+static void prefetch_job_free(PrefetchJob *job)
+{
+	g_free(job->server);
+	g_free(job->dictionary);
+	g_strfreev(job->words);
+	g_free(job);
+}
+
+
+/* Looks up the words which are not cached yet one after another and stores their
+ * definitions in the cache */
+static void prefetch_thread(gpointer data, gpointer user_data)
+{
+	PrefetchJob *job = data;
+	DictConnection *conn = NULL;
+	gchar *database;
+	gsize received = 0;
+	gint status;
+	guint i;
+
+	database = dict_query_database_name(job->dictionary);
+	for (i = 0; job->words[i] != NULL && received < DICT_PREFETCH_MAX_BYTES; i++)
+	{
+		/* the user moved on to another definition, whose links are more useful */
+		if ((guint) g_atomic_int_get(&prefetch_generation) != job->generation)
+			break;
+		if (dict_cache_contains(job->server, job->port, database, job->words[i]))
+			continue;
+		/* a search of the user must not wait for the rate limit because of prefetching */
+		if (! rate_limit_spare(job->server, job->port))
+			break;
+
+		status = define_word(&conn, job->server, job->port, database, job->words[i], NULL,
+			&received);
+		if (status != NO_ERROR && status != NOTHING_FOUND)
+			break;
+	}
+	/* the connection is put back into the pool, ready for the next lookup */
+	dict_connection_pool_put(conn);
+	g_free(database);
+
+	prefetch_job_free(job);
+}
+
+
+/* Looks up the first few of the words in the background so that following a link to them
+ * is answered from the cache. Only one prefetch runs at a time and a new one replaces the
+ * queued and the running ones. */
+void dict_query_prefetch(const gchar *server, gint port, const gchar *dictionary,
+						 const gchar * const *words)
+{
+	PrefetchJob *job;
+	GPtrArray *unique = g_ptr_array_new();
+	guint i, j;
+
+	/* definitions often refer to the same word more than once */
+	for (i = 0; words[i] != NULL && unique->len < DICT_PREFETCH_MAX_WORDS; i++)
+	{
+		if (! NZV(words[i]))
+			continue;
+		for (j = 0; j < unique->len; j++)
+		{
+			if (strcmp(g_ptr_array_index(unique, j), words[i]) == 0)
+				break;
+		}
+		if (j == unique->len)
+			g_ptr_array_add(unique, g_strdup(words[i]));
+	}
+	if (unique->len == 0)
+	{
+		g_ptr_array_free(unique, TRUE);
+		return;
+	}
+	g_ptr_array_add(unique, NULL);
+
+	job = g_new0(PrefetchJob, 1);
+	job->server = g_strdup(server);
+	job->port = port;
+	job->dictionary = g_strdup(dictionary);
+	job->words = (gchar **) g_ptr_array_free(unique, FALSE);
+	job->generation = (guint) g_atomic_int_add(&prefetch_generation, 1) + 1;
+
+	G_LOCK(prefetch);
+	if (prefetch_pool == NULL)
+		prefetch_pool = g_thread_pool_new(prefetch_thread, NULL, 1, FALSE, NULL);
+	G_UNLOCK(prefetch);
+
+	g_thread_pool_push(prefetch_pool, job, NULL);
+}
+
+
+void dict_spell_result_free(DictSpellResult *result)
+{
+	g_free(result->word);
+	g_strfreev(result->suggestions);
+	g_free(result);
+}
+
+
+static GSubprocess *spell_spawn(const gchar *spell_bin, const gchar *dictionary, GError **error)
+{
+	GSubprocess *proc;
+	gchar *locale_cmd;
+	const gchar *argv[5];
+	gint64 start = dict_stats_start();
+
+	locale_cmd = g_locale_from_utf8(spell_bin, -1, NULL, NULL, NULL);
+	if (locale_cmd == NULL)
+		locale_cmd = g_strdup(spell_bin);
+
+	argv[0] = locale_cmd;
+	argv[1] = "-a";
+	argv[2] = "-d";
+	argv[3] = dictionary;
+	argv[4] = NULL;
+
+	proc = g_subprocess_newv(argv,
+		G_SUBPROCESS_FLAGS_STDIN_PIPE | G_SUBPROCESS_FLAGS_STDOUT_PIPE |
+		G_SUBPROCESS_FLAGS_STDERR_SILENCE, error);
+	g_free(locale_cmd);
+	if (proc != NULL)
+		dict_stats_end(DICT_STATS_SPELL_SPAWN, start);
+
+	return proc;
+}
+
+
+/* Creates the result for a word from the first line of the spell checker's answer, which
+ * may be NULL or empty if there was no output at all */
+static DictSpellResult *spell_parse_answer(const gchar *word, const gchar *line)
+{
+	DictSpellResult *result = g_new0(DictSpellResult, 1);
+	const gchar *start;
+	guint n;
+
+	result->word = g_strdup(word);
+
+	if (line != NULL && line[0] == '&')
+	{	/* & word 17 7: suggestion, suggestion, ... */
+		start = strchr(line, ':');
+		result->suggestions = g_strsplit((start != NULL && start[1] != '\0') ? start + 2 : "",
+			", ", -1);
+		n = g_strv_length(result->suggestions);
+		if (n > 0)
+			g_strchomp(result->suggestions[n - 1]);
+	}
+	else if (line != NULL && line[0] == '#')
+		result->suggestions = g_new0(gchar *, 1);
+	else
+	{	/* '*', '+' and '-' or no output at all, e.g. for numbers */
+		result->suggestions = g_new0(gchar *, 2);
+		result->suggestions[0] = g_strdup(word);
+	}
+	return result;
+}
+
+
+/* Checks all words with a single spell checker process. For every word a DictSpellResult
+ * is appended to 'results'. The suggestions of correctly spelled words contain only the
+ * word itself, an empty list means the word is unknown and nothing similar was found. */
+gboolean dict_query_spell(const gchar *spell_bin, const gchar *dictionary,
+						  const gchar * const *words, GPtrArray *results, GError **error)
+{
+	GSubprocess *proc;
+	GString *input;
+	gchar *output = NULL;
+	gchar *word;
+	gchar **lines;
+	guint i, line_no;
+
+	if ((proc = spell_spawn(spell_bin, dictionary, error)) == NULL)
+		return FALSE;
+
+	/* one word per line, the leading '^' makes sure a line is never taken as a command */
+	input = g_string_sized_new(256);
+	for (i = 0; words[i] != NULL; i++)
+	{
+		word = g_strdup(words[i]);
+		g_strdelimit(word, "\r\n", ' ');
+		g_string_append_printf(input, "^%s\n", word);
+		g_free(word);
+	}
+
+	if (! g_subprocess_communicate_utf8(proc, input->str, NULL, &output, NULL, error))
+	{
+		g_string_free(input, TRUE);
+		g_object_unref(proc);
+		return FALSE;
+	}
+	g_string_free(input, TRUE);
+	g_object_unref(proc);
+
+	/* the answer for each line is terminated by an empty line, the first line is the
+	 * version banner */
+	lines = g_strsplit(output, "\n", -1);
+	line_no = (lines[0] != NULL && lines[0][0] == '@') ? 1 : 0;
+	for (i = 0; words[i] != NULL; i++)
+	{
+		g_ptr_array_add(results, spell_parse_answer(words[i], lines[line_no]));
+
+		/* skip the rest of the answer */
+		while (lines[line_no] != NULL && lines[line_no][0] != '\0')
+			line_no++;
+		if (lines[line_no] != NULL)
+			line_no++;
+	}
+	g_strfreev(lines);
+	g_free(output);
+
+	return TRUE;
+}
+
+
+/* Starts a spell checker process which is kept running for checking many words one
+ * after another. A session may be shared between threads. */
+DictSpellSession *dict_spell_session_new(const gchar *spell_bin, const gchar *dictionary,
+										 GError **error)
+{
+	DictSpellSession *session;
+	GSubprocess *proc;
+	gchar *banner;
+
+	if ((proc = spell_spawn(spell_bin, dictionary, error)) == NULL)
+		return NULL;
+
+	session = g_new0(DictSpellSession, 1);
+	g_mutex_init(&session->lock);
+	session->proc = proc;
+	session->input = g_subprocess_get_stdin_pipe(proc);
+	session->output = g_data_input_stream_new(g_subprocess_get_stdout_pipe(proc));
+
+	/* skip the version banner */
+	banner = g_data_input_stream_read_line(session->output, NULL, NULL, error);
+	if (banner == NULL)
+	{
+		if (error != NULL && *error == NULL)
+			g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+				_("The spell checker quit unexpectedly."));
+		dict_spell_session_free(session);
+		return NULL;
+	}
+	g_free(banner);
+
+	return session;
+}
+
+
+/* Checks a single word. Returns NULL if the spell checker failed. */
+DictSpellResult *dict_spell_session_check(DictSpellSession *session, const gchar *word,
+										  GError **error)
+{
+	DictSpellResult *result = NULL;
+	gchar *input, *line, *first = NULL;
+	GError *read_error = NULL;
+
+	input = g_strdup_printf("^%s\n", word);
+	g_strdelimit(input + 1, "\r\n", ' ');
+	input[strlen(input) - 1] = '\n';
+
+	g_mutex_lock(&session->lock);
+	if (g_output_stream_write_all(session->input, input, strlen(input), NULL, NULL, error) &&
+		g_output_stream_flush(session->input, NULL, error))
+	{
+		/* the answer is terminated by an empty line */
+		while ((line = g_data_input_stream_read_line(session->output, NULL, NULL,
+					&read_error)) != NULL && *line != '\0')
+		{
+			if (first == NULL)
+				first = line;
+			else
+				g_free(line);
+		}
+
+		if (line != NULL)
+		{
+			result = spell_parse_answer(word, first);
+			g_free(line);
+		}
+		else if (read_error != NULL)
+			g_propagate_error(error, read_error);
+		else
+			g_set_error_literal(error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+				_("The spell checker quit unexpectedly."));
+		g_free(first);
+	}
+	g_mutex_unlock(&session->lock);
+	g_free(input);
+
+	return result;
+}
+
+
+void dict_spell_session_free(DictSpellSession *session)
+{
+	if (session == NULL)
+		return;
+
+	/* the spell checker quits when its input is closed */
+	g_output_stream_close(session->input, NULL, NULL);
+	g_subprocess_wait(session->proc, NULL, NULL);
+
+	g_object_unref(session->output);
+	g_object_unref(session->proc);
+	g_mutex_clear(&session->lock);
+	g_free(session);
+}
+
+
+/* Creates a query of the given dictd server, 'strategy' is only used by match queries and
+ * 'words' may be NULL. The settings are copied. */
+DictQuery *dict_query_new(DictQueryType type, const gchar *server, gint port,
+						  const gchar *dictionary, const gchar *strategy,
+						  const gchar * const *words)
+{
+	DictQuery *query = g_new0(DictQuery, 1);
+
+	query->type = type;
+	query->server = g_strdup(server);
+	query->port = port;
+	query->dictionary = g_strdup(dictionary);
+	query->strategy = g_strdup(strategy);
+	query->words = g_strdupv((gchar **) words);
+
+	return query;
+}
+
+
+/* Sets the spell check command and its dictionary used by spell queries */
+void dict_query_set_spell_checker(DictQuery *query, const gchar *spell_bin,
+								  const gchar *dictionary)
+{
+	g_free(query->spell_bin);
+	g_free(query->spell_dictionary);
+	query->spell_bin = g_strdup(spell_bin);
+	query->spell_dictionary = g_strdup(dictionary);
+}
+
+
+void dict_query_free(DictQuery *query)
+{
+	g_free(query->server);
+	g_free(query->dictionary);
+	g_free(query->strategy);
+	g_free(query->spell_bin);
+	g_free(query->spell_dictionary);
+	g_strfreev(query->words);
+	g_free(query->error_message);
+	if (query->results != NULL)
+		g_ptr_array_free(query->results, TRUE);
+	g_free(query);
+}
+
+
+/* Runs the query and blocks until it is done */
+void dict_query_run(DictQuery *query)
+{
+	GError *error = NULL;
+	const gchar *no_words[] = { NULL };
+	const gchar * const *words = (query->words != NULL) ?
+		(const gchar * const *) query->words : no_words;
+
+	switch (query->type)
+	{
+		case DICT_QUERY_DEFINE:
+		{
+			query->results = g_ptr_array_new_with_free_func((GDestroyNotify) dict_definition_free);
+			query->status = dict_query_define(query->server, query->port, query->dictionary,
+				words, query->results);
+			/* keep what we got so far even if a later lookup failed */
+			if (query->status != NO_ERROR && query->results->len == 0)
+				query->error_message = g_strdup(dict_query_status_message(query->status));
+			break;
+		}
+		case DICT_QUERY_MATCH:
+		{
+			query->results = g_ptr_array_new_with_free_func((GDestroyNotify) dict_match_free);
+			query->status = dict_query_match(query->server, query->port, query->dictionary,
+				query->strategy, (words[0] != NULL) ? words[0] : "", query->results);
+			if (query->status != NO_ERROR)
+				query->error_message = g_strdup(dict_query_status_message(query->status));
+			break;
+		}
+		case DICT_QUERY_SPELL:
+		{
+			query->results = g_ptr_array_new_with_free_func((GDestroyNotify) dict_spell_result_free);
+			query->status = NO_ERROR;
+			if (! NZV(query->spell_bin))
+			{
+				query->status = BAD_COMMAND;
+				query->error_message = g_strdup(
+					_("Please set the spell check command in the preferences dialog."));
+			}
+			else if (! dict_query_spell(query->spell_bin, query->spell_dictionary, words,
+						query->results, &error))
+			{
+				query->status = BAD_COMMAND;
+				query->error_message = g_strdup(error->message);
+				g_error_free(error);
+			}
+			break;
+		}
+	}
+}
+
+
+static void query_thread(GTask *task, gpointer source, gpointer data, GCancellable *cancellable)
+{
+	dict_query_run(data);
+	g_task_return_boolean(task, TRUE);
+}
+
+
+static void query_finished_cb(GObject *source, GAsyncResult *res, gpointer data)
+{
+	DictQuery *query = data;
+
+	query->callback(query, query->callback_data);
+	dict_query_free(query);
+}
+
+
+/* Runs the query in a worker thread. The callback is called in the current thread-default
+ * main context when the query is done, afterwards the query is freed. */
+void dict_query_run_async(DictQuery *query, DictQueryCallback callback, gpointer user_data)
+{
+	GTask *task;
+
+	query->callback = callback;
+	query->callback_data = user_data;
+
+	task = g_task_new(NULL, NULL, query_finished_cb, query);
+	g_task_set_task_data(task, query, NULL);
+	g_task_run_in_thread(task, query_thread);
+	g_object_unref(task);
+}
@@ -0,0 +1,137 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef QUERY_H
+#define QUERY_H 1
+
+#include <glib.h>
+
+#include "dictparser.h"
+
+
+/* Returns: TRUE if ptr points to a non-zero value. */
+#define NZV(ptr) \
+	((ptr) && (ptr)[0])
+
+
+/* a server setting starting with this is the path of a Unix domain socket */
+#define DICT_UNIX_SOCKET_PREFIX	"unix:"
+
+
+/* the status of a query */
+enum
+{
+	NO_ERROR,
+	NO_CONNECTION,
+	NOTHING_FOUND,
+	NO_DATABASES,
+	UNKNOWN_DATABASE,
+	BAD_COMMAND,
+	SERVER_NOT_READY
+};
+
+
+typedef struct _DictConnection DictConnection;
+typedef struct _DictSpellSession DictSpellSession;
+
+typedef struct
+{
+	gchar *word;
+	gchar **suggestions;
+} DictSpellResult;
+
+typedef enum
+{
+	DICT_QUERY_DEFINE,
+	DICT_QUERY_MATCH,
+	DICT_QUERY_SPELL
+} DictQueryType;
+
+typedef struct _DictQuery DictQuery;
+
+typedef void (*DictQueryCallback) (DictQuery *query, gpointer user_data);
+
+struct _DictQuery
+{
+	DictQueryType type;
+
+	/* settings, copied so that the query can run in any thread */
+	gchar *server;
+	gint port;
+	gchar *dictionary;
+	gchar *strategy;
+	gchar *spell_bin;
+	gchar *spell_dictionary;
+
+	gchar **words;
+
+	/* results */
+	gint status;
+	gchar *error_message;	/* NULL on success */
+	GPtrArray *results;		/* DictDefinition, DictMatch or DictSpellResult items */
+
+	DictQueryCallback callback;
+	gpointer callback_data;
+};
+
+
+DictConnection *dict_connection_open(const gchar *server, gint port, gint *status);
+gint dict_connection_command(DictConnection *conn, const gchar *command, DictReply **reply);
+gint dict_connection_commands(DictConnection *conn, const gchar * const *commands,
+							  DictReply **replies);
+void dict_connection_close(DictConnection *conn);
+
+DictConnection *dict_connection_pool_get(const gchar *server, gint port, gint *status);
+void dict_connection_pool_put(DictConnection *conn);
+void dict_connection_pool_clear(void);
+void dict_connection_pool_warm_up(const gchar *server, gint port);
+
+DictSpellSession *dict_spell_session_new(const gchar *spell_bin, const gchar *dictionary,
+										 GError **error);
+DictSpellResult *dict_spell_session_check(DictSpellSession *session, const gchar *word,
+										  GError **error);
+void dict_spell_session_free(DictSpellSession *session);
+
+gchar *dict_query_database_name(const gchar *dictionary);
+gchar *dict_query_quote_word(const gchar *word);
+const gchar *dict_query_status_message(gint status);
+
+gint dict_query_define(const gchar *server, gint port, const gchar *dictionary,
+					   const gchar * const *words, GPtrArray *definitions);
+void dict_query_join_define(const gchar *server, gint port, const gchar *database,
+							const gchar *word);
+gint dict_query_match(const gchar *server, gint port, const gchar *dictionary,
+					  const gchar *strategy, const gchar *word, GPtrArray *matches);
+gboolean dict_query_spell(const gchar *spell_bin, const gchar *dictionary,
+						  const gchar * const *words, GPtrArray *results, GError **error);
+void dict_query_prefetch(const gchar *server, gint port, const gchar *dictionary,
+						 const gchar * const *words);
+
+DictQuery *dict_query_new(DictQueryType type, const gchar *server, gint port,
+						  const gchar *dictionary, const gchar *strategy,
+						  const gchar * const *words);
+void dict_query_set_spell_checker(DictQuery *query, const gchar *spell_bin,
+								  const gchar *dictionary);
+void dict_query_run(DictQuery *query);
+void dict_query_run_async(DictQuery *query, DictQueryCallback callback, gpointer user_data);
+void dict_query_free(DictQuery *query);
+
+void dict_spell_result_free(DictSpellResult *result);
+
+
+#endif
@@ -0,0 +1,361 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+/* The scan popup: a small window near the pointer showing the definition of the word
+ * which was just selected in any application. The PRIMARY selection is watched through
+ * its owner-change signal and its text is requested asynchronously, the window is created
+ * in advance and the lookup goes through the definition cache and the connection pool, so
+ * a cached word is shown without any round trip to the server. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <gtk/gtk.h>
+#include <libxfce4util/libxfce4util.h>
+
+#include "common.h"
+#include "dictparser.h"
+#include "query.h"
+#include "cache.h"
+#include "scanpopup.h"
+
+
+/* longer selections are taken as text rather than a word and are not looked up */
+#define DICT_SCAN_POPUP_MAX_WORD	64
+/* of the first definition, the rest is shown in the main window */
+#define DICT_SCAN_POPUP_MAX_CHARS	400
+/* distance to the pointer in pixels */
+#define DICT_SCAN_POPUP_OFFSET		12
+/* hide the popup after some seconds unless the pointer is on it */
+#define DICT_SCAN_POPUP_TIMEOUT		8
+
+
+struct _DictScanPopup
+{
+	DictData *dd;
+	GtkWidget *window;
+	GtkWidget *title_label;
+	GtkWidget *text_label;
+	gchar *word;		/* the word shown or being looked up */
+	gint64 start;		/* when the selection changed */
+	guint hide_source;
+	gboolean closed;	/* set by dict_scan_popup_free(), callbacks may still be pending */
+	gint ref_count;
+};
+
+
+static DictScanPopup *scan_popup_ref(DictScanPopup *popup)
+{
+	popup->ref_count++;
+	return popup;
+}
+
+
+static void scan_popup_unref(DictScanPopup *popup)
+{
+	if (--popup->ref_count > 0)
+		return;
+
+	g_free(popup->word);
+	g_free(popup);
+}
+
+
+static void scan_popup_hide(DictScanPopup *popup)
+{
+	if (popup->hide_source != 0)
+	{
+		g_source_remove(popup->hide_source);
+		popup->hide_source = 0;
+	}
+	gtk_widget_hide(popup->window);
+}
+
+
+static gboolean scan_popup_timeout(gpointer data)
+{
+	DictScanPopup *popup = data;
+
+	popup->hide_source = 0;
+	gtk_widget_hide(popup->window);
+
+	return FALSE;
+}
+
+
+/* Places the popup below right of the pointer or, if there is no room, above left of it */
+static void scan_popup_move(DictScanPopup *popup)
+{
+	GdkDisplay *display = gtk_widget_get_display(popup->window);
+	GdkDevice *pointer = gdk_seat_get_pointer(gdk_display_get_default_seat(display));
+	GdkRectangle area;
+	GtkRequisition size;
+	gint x, y;
+
+	gdk_device_get_position(pointer, NULL, &x, &y);
+	gdk_monitor_get_workarea(gdk_display_get_monitor_at_point(display, x, y), &area);
+	gtk_widget_get_preferred_size(popup->window, NULL, &size);
+
+	x += DICT_SCAN_POPUP_OFFSET;
+	y += DICT_SCAN_POPUP_OFFSET;
+	if (x + size.width > area.x + area.width)
+		x = MAX(area.x, x - size.width - 2 * DICT_SCAN_POPUP_OFFSET);
+	if (y + size.height > area.y + area.height)
+		y = MAX(area.y, y - size.height - 2 * DICT_SCAN_POPUP_OFFSET);
+
+	gtk_window_move(GTK_WINDOW(popup->window), x, y);
+}
+
+
+/* Shows the beginning of the first definition */
+static void scan_popup_show(DictScanPopup *popup, GPtrArray *definitions, gboolean cached)
+{
+	DictDefinition *def = g_ptr_array_index(definitions, 0);
+	GString *text = g_string_sized_new(1024);
+	GArray *spans = g_array_new(FALSE, FALSE, sizeof(DictSpan));
+	gchar *markup, *more;
+	const gchar *end;
+
+	dict_parser_markup(def->definition, text, spans, NULL);
+	g_array_free(spans, TRUE);
+
+	while (text->len > 0 && g_ascii_isspace(text->str[text->len - 1]))
+		g_string_truncate(text, text->len - 1);
+	if (g_utf8_strlen(text->str, -1) > DICT_SCAN_POPUP_MAX_CHARS)
+	{
+		end = g_utf8_offset_to_pointer(text->str, DICT_SCAN_POPUP_MAX_CHARS);
+		g_string_truncate(text, end - text->str);
+		g_string_append(text, "\342\200\246");	/* ellipsis */
+	}
+	if (definitions->len > 1)
+	{
+		more = g_strdup_printf(ngettext("%u more definition, click to show all",
+										"%u more definitions, click to show all",
+										definitions->len - 1), definitions->len - 1);
+		g_string_append(text, "\n\n");
+		g_string_append(text, more);
+		g_free(more);
+	}
+
+	markup = g_markup_printf_escaped("<b>%s</b>  <small>%s</small>",
+		popup->word, def->description);
+	gtk_label_set_markup(GTK_LABEL(popup->title_label), markup);
+	gtk_label_set_text(GTK_LABEL(popup->text_label), text->str);
+	g_free(markup);
+	g_string_free(text, TRUE);
+
+	/* shrink the popup if the previous text was longer */
+	if (gtk_widget_get_visible(popup->window))
+		gtk_window_resize(GTK_WINDOW(popup->window), 1, 1);
+	scan_popup_move(popup);
+	gtk_widget_show_all(popup->window);
+
+	if (popup->hide_source != 0)
+		g_source_remove(popup->hide_source);
+	popup->hide_source = g_timeout_add_seconds(DICT_SCAN_POPUP_TIMEOUT, scan_popup_timeout, popup);
+
+	if (popup->dd->verbose_mode)
+		g_message("Scan popup for \"%s\" rendered after %.1f ms%s", popup->word,
+			(g_get_monotonic_time() - popup->start) / 1000.0, cached ? " (cached)" : "");
+}
+
+
+static void scan_popup_query_done(DictQuery *query, gpointer data)
+{
+	DictScanPopup *popup = data;
+
+	/* drop the result if another word was selected in the meantime */
+	if (! popup->closed && g_strcmp0(query->words[0], popup->word) == 0)
+	{
+		if (query->results->len > 0)
+			scan_popup_show(popup, query->results, FALSE);
+		else if (popup->dd->verbose_mode)
+			g_message("Scan popup: nothing found for \"%s\" (%s)", popup->word,
+				(query->error_message != NULL) ? query->error_message : "no definitions");
+	}
+	scan_popup_unref(popup);
+}
+
+
+static gboolean scan_popup_is_word(const gchar *text)
+{
+	return NZV(text) && strlen(text) <= DICT_SCAN_POPUP_MAX_WORD &&
+		strpbrk(text, "\r\n\t") == NULL && g_utf8_validate(text, -1, NULL);
+}
+
+
+static void scan_popup_text_received(GtkClipboard *clipboard, const gchar *text, gpointer data)
+{
+	DictScanPopup *popup = data;
+	DictData *dd = popup->dd;
+	DictQuery *query;
+	GPtrArray *definitions;
+	gchar *word, *database;
+	const gchar *words[2] = { NULL, NULL };
+
+	word = g_strstrip(g_strdup(text));
+	if (popup->closed || ! scan_popup_is_word(word) ||
+		(g_strcmp0(word, popup->word) == 0 && gtk_widget_get_visible(popup->window)))
+	{
+		g_free(word);
+		scan_popup_unref(popup);
+		return;
+	}
+	g_free(popup->word);
+	popup->word = word;
+
+	database = dict_query_database_name(dd->dictionary);
+	definitions = dict_cache_lookup(dd->server, dd->port, database, word);
+	g_free(database);
+
+	if (definitions != NULL)
+	{
+		scan_popup_show(popup, definitions, TRUE);
+		g_ptr_array_free(definitions, TRUE);
+	}
+	else
+	{
+		/* the popup is shown once the definition arrived, nothing is shown for words
+		 * without one as most selections are not meant to be looked up */
+		words[0] = word;
+		query = dict_query_new(DICT_QUERY_DEFINE, dd->server, dd->port, dd->dictionary,
+			NULL, words);
+		dict_query_run_async(query, scan_popup_query_done, scan_popup_ref(popup));
+	}
+	scan_popup_unref(popup);
+}
+
+
+static void scan_popup_owner_change(GtkClipboard *clipboard, GdkEvent *event, DictScanPopup *popup)
+{
+	/* selections in our own windows, e.g. of a word in the results, are not looked up */
+	if (! popup->dd->scan_selection || gtk_clipboard_get_owner(clipboard) != NULL)
+		return;
+
+	popup->start = g_get_monotonic_time();
+	gtk_clipboard_request_text(clipboard, scan_popup_text_received, scan_popup_ref(popup));
+}
+
+
+/* A click shows all definitions in the main window */
+static gboolean scan_popup_button_press(GtkWidget *widget, GdkEventButton *event,
+										DictScanPopup *popup)
+{
+	gchar *word = g_strdup(popup->word);
+
+	scan_popup_hide(popup);
+	dict_search_word(popup->dd, word);
+	g_free(word);
+
+	return TRUE;
+}
+
+
+static gboolean scan_popup_crossing(GtkWidget *widget, GdkEventCrossing *event,
+									DictScanPopup *popup)
+{
+	if (event->detail == GDK_NOTIFY_INFERIOR)
+		return FALSE;
+
+	/* keep the popup while the pointer is on it and hide it when the pointer leaves */
+	if (event->type == GDK_ENTER_NOTIFY && popup->hide_source != 0)
+	{
+		g_source_remove(popup->hide_source);
+		popup->hide_source = 0;
+	}
+	else if (event->type == GDK_LEAVE_NOTIFY)
+		scan_popup_hide(popup);
+
+	return FALSE;
+}
+
+
+/* Creates the popup and starts watching the selection if the scan popup is enabled, it
+ * is safe to call this again after the setting was changed */
+void dict_scan_popup_init(DictData *dd)
+{
+	DictScanPopup *popup;
+	GtkWidget *frame, *vbox;
+
+	if (dd->scan_popup != NULL || ! dd->scan_selection)
+		return;
+
+	popup = g_new0(DictScanPopup, 1);
+	popup->dd = dd;
+	popup->ref_count = 1;
+
+	popup->window = gtk_window_new(GTK_WINDOW_POPUP);
+	gtk_window_set_type_hint(GTK_WINDOW(popup->window), GDK_WINDOW_TYPE_HINT_TOOLTIP);
+	gtk_window_set_resizable(GTK_WINDOW(popup->window), FALSE);
+	gtk_widget_add_events(popup->window,
+		GDK_BUTTON_PRESS_MASK | GDK_ENTER_NOTIFY_MASK | GDK_LEAVE_NOTIFY_MASK);
+
+	frame = gtk_frame_new(NULL);
+	gtk_container_add(GTK_CONTAINER(popup->window), frame);
+
+	vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 6);
+	gtk_container_set_border_width(GTK_CONTAINER(vbox), 8);
+	gtk_container_add(GTK_CONTAINER(frame), vbox);
+
+	popup->title_label = gtk_label_new(NULL);
+	gtk_label_set_xalign(GTK_LABEL(popup->title_label), 0.0);
+	gtk_label_set_ellipsize(GTK_LABEL(popup->title_label), PANGO_ELLIPSIZE_END);
+	gtk_label_set_max_width_chars(GTK_LABEL(popup->title_label), 60);
+	gtk_box_pack_start(GTK_BOX(vbox), popup->title_label, FALSE, FALSE, 0);
+
+	popup->text_label = gtk_label_new(NULL);
+	gtk_label_set_xalign(GTK_LABEL(popup->text_label), 0.0);
+	gtk_label_set_line_wrap(GTK_LABEL(popup->text_label), TRUE);
+	gtk_label_set_max_width_chars(GTK_LABEL(popup->text_label), 60);
+	gtk_box_pack_start(GTK_BOX(vbox), popup->text_label, FALSE, FALSE, 0);
+
+	g_signal_connect(popup->window, "button-press-event",
+		G_CALLBACK(scan_popup_button_press), popup);
+	g_signal_connect(popup->window, "enter-notify-event", G_CALLBACK(scan_popup_crossing), popup);
+	g_signal_connect(popup->window, "leave-notify-event", G_CALLBACK(scan_popup_crossing), popup);
+
+	/* realize it now, so that showing it later only has to map it */
+	gtk_widget_realize(popup->window);
+
+	g_signal_connect(gtk_clipboard_get(GDK_SELECTION_PRIMARY), "owner-change",
+		G_CALLBACK(scan_popup_owner_change), popup);
+
+	dd->scan_popup = popup;
+}
+
+
+void dict_scan_popup_free(DictData *dd)
+{
+	DictScanPopup *popup = dd->scan_popup;
+
+	if (popup == NULL)
+		return;
+
+	g_signal_handlers_disconnect_by_data(gtk_clipboard_get(GDK_SELECTION_PRIMARY), popup);
+	scan_popup_hide(popup);
+	gtk_widget_destroy(popup->window);
+	popup->closed = TRUE;
+	dd->scan_popup = NULL;
+
+	scan_popup_unref(popup);
+}
@@ -24,10 +24,23 @@
 
 #include "common.h"
 #include "speedreader.h"
+#include "stats.h"
 
 
 typedef struct _XfdSpeedReaderPrivate			XfdSpeedReaderPrivate;
 
+/* A group of words as it is flashed on the screen, shaped ahead of time */
+typedef struct
+{
+	PangoLayout *layout;
+	guint start;	/* index of the first word */
+	guint end;		/* index of the first word after the group */
+	guint n_words;	/* including the paragraph signs */
+	guint n_real_words;	/* without the paragraph signs, for the measured speed */
+	gdouble weight;
+	gint orp_x;		/* horizontal offset of the optimal recognition point in pixels */
+} SrGroup;
+
 struct _XfdSpeedReaderPrivate
 {
 	GtkWidget *first_page;
@@ -41,7 +54,8 @@ struct _XfdSpeedReaderPrivate
 	GtkWidget *spin_grouping;
 	GtkWidget *button_font;
 	GtkWidget *check_mark_paragraphs;
-	GtkWidget *display_label;
+	GtkWidget *display;
+	GtkWidget *wpm_label;
 	GtkTextBuffer *buffer;
 
 	guint timer_id;
@@ -51,6 +65,29 @@ struct _XfdSpeedReaderPrivate
 
 	GString *group;
 	gsize group_size;
+	guint group_start;	/* index of the first word of the displayed group */
+
+	SrGroup *current;	/* the displayed group */
+	GQueue *ahead;		/* the next groups, starting at word_idx */
+	guint prepare_id;
+	PangoFontDescription *font;
+
+	/* position index, built while splitting the text into words */
+	GArray *sentence_starts;
+	GArray *paragraph_starts;
+	guint *word_sentence;	/* sentence number of each word */
+	guint *word_paragraph;	/* paragraph number of each word */
+	gchar *text_hash;
+
+	GtkWidget *scale_position;
+
+	/* timing, all values are monotonic time in microseconds */
+	gdouble word_interval;	/* display time of a word with weight 1.0 */
+	gint64 next_deadline;	/* absolute time when the next group is due */
+	gint64 resume_time;		/* start of the current running (not paused) period */
+	gint64 active_time;		/* accumulated running time of previous periods */
+	gint64 wpm_update_time;	/* last update of the measured rate label */
+	guint words_shown;
 
 	gboolean paused;
 
@@ -74,6 +111,17 @@ enum
 #define XFD_TITLE_PAUSE _("P_ause")
 #define XFD_TITLE_RESUME _("_Resume")
 
+/* if the main loop was blocked for longer than this, don't try to catch up by
+ * flashing the missed groups but continue from now on */
+#define SR_MAX_LATENESS		G_USEC_PER_SEC
+/* number of groups which are laid out in advance */
+#define SR_GROUPS_AHEAD			8
+/* update the measured words per minute at most twice a second */
+#define SR_WPM_UPDATE_INTERVAL	(G_USEC_PER_SEC / 2)
+/* number of texts for which the reading position is remembered */
+#define SR_MAX_BOOKMARKS		50
+#define SR_BOOKMARKS_FILE		"xfce4-dict/speedreader-positions.rc"
+
 
 G_DEFINE_TYPE_WITH_PRIVATE(XfdSpeedReader, xfd_speed_reader, GTK_TYPE_DIALOG);
 
@@ -84,11 +132,18 @@ static void sr_pause(XfdSpeedReader *dialog, gboolean paused);
 
 static void xfd_speed_reader_finalize(GObject *object)
 {
+	XfdSpeedReaderPrivate *priv;
+
 	g_return_if_fail(object != NULL);
 	g_return_if_fail(IS_XFD_SPEED_READER(object));
 
 	sr_stop_timer(XFD_SPEED_READER(object));
 
+	priv = xfd_speed_reader_get_instance_private(XFD_SPEED_READER(object));
+	g_queue_free(priv->ahead);
+	if (priv->font != NULL)
+		pango_font_description_free(priv->font);
+
 	G_OBJECT_CLASS(xfd_speed_reader_parent_class)->finalize(object);
 }
 
@@ -102,14 +157,24 @@ static void xfd_speed_reader_class_init(XfdSpeedReaderClass *klass)
 }
 
 
+static gboolean sr_is_paragraph_sign(const gchar *word)
+{
+	return g_utf8_get_char(word) == 182;
+}
+
+
 /* Based on GLib's g_strsplit_set() but slightly modified to split exactly what we need for
- * speed reading (e.g. splitting but not removing dashes). */
-static gchar **sr_strsplit_set(const gchar *string, const gchar *delimiters)
+ * speed reading (e.g. splitting but not removing dashes).
+ * The index of each token starting a paragraph (i.e. the first token after an empty line) is
+ * appended to paragraph_starts. */
+static gchar **sr_strsplit_set(const gchar *string, const gchar *delimiters,
+							   GArray *paragraph_starts)
 {
 	gboolean delim_table[256];
 	GSList *tokens, *list;
 	gint n_tokens;
 	guint x;
+	guint newlines = 2; /* the start of the text starts a paragraph */
 	const gchar *s;
 	const gchar *current;
 	gchar *token;
@@ -139,15 +204,25 @@ static gchar **sr_strsplit_set(const gchar *string, const gchar *delimiters)
 		{
 			x = (*s == '-') ? 1 : 0;
 			token = g_strndup(current, s - current + x);
+			if (*token != '\0' && ! sr_is_paragraph_sign(token))
+			{
+				if (newlines >= 2)
+					g_array_append_val(paragraph_starts, n_tokens);
+				newlines = 0;
+			}
 			tokens = g_slist_prepend(tokens, token);
 			++n_tokens;
 
+			if (*s == '\n')
+				newlines++;
 			current = s + 1;
 		}
 		++s;
 	}
 
 	token = g_strndup(current, s - current);
+	if (*token != '\0' && ! sr_is_paragraph_sign(token) && newlines >= 2)
+		g_array_append_val(paragraph_starts, n_tokens);
 	tokens = g_slist_prepend(tokens, token);
 	++n_tokens;
 
@@ -278,24 +353,366 @@ static void xfd_speed_reader_set_window_title(XfdSpeedReader *dialog, gint state
 }
 
 
-static void sr_set_label_text(XfdSpeedReader *dialog)
+/* Returns the relative display time of a word. Long words and words followed by punctuation
+ * need more time to be recognised, so they are shown longer than short ones. */
+static gdouble sr_word_weight(const gchar *word)
+{
+	glong len;
+	gunichar last;
+	gdouble weight = 1.0;
+
+	if (! NZV(word))
+		return 0.0;
+
+	len = g_utf8_strlen(word, -1);
+	if (len > 6)
+		weight += MIN(len - 6, 10) * 0.08;
+	else if (len < 3)
+		weight -= 0.2;
+
+	last = g_utf8_get_char(g_utf8_find_prev_char(word, word + strlen(word)));
+	switch (last)
+	{
+		case '.':
+		case '!':
+		case '?':
+		case 182: /* paragraph sign */
+			weight += 1.0;
+			break;
+		case ',':
+		case ';':
+		case ':':
+		case ')':
+			weight += 0.5;
+			break;
+	}
+
+	return weight;
+}
+
+
+/* Collects the group of words starting at idx into str */
+static void sr_collect_group(XfdSpeedReaderPrivate *priv, guint idx, GString *str, SrGroup *group)
+{
+	gsize i;
+	const gchar *word;
+
+	group->weight = 0.0;
+	group->n_words = 0;
+	group->n_real_words = 0;
+
+	/* skip empty elements */
+	while (idx < priv->words_len && ! NZV(priv->words[idx]))
+		idx++;
+	group->start = idx;
+
+	for (i = 0; (i < priv->group_size) && (idx < priv->words_len); i++)
+	{
+		/* skip empty elements */
+		while (idx < priv->words_len && ! NZV(priv->words[idx]))
+			idx++;
+
+		if (idx < priv->words_len)
+		{
+			word = priv->words[idx];
+			group->weight += sr_word_weight(word);
+			group->n_words++;
+
+			if (sr_is_paragraph_sign(word))
+			{	/* paragraph sign inside the group */
+				g_string_append_unichar(str, 182);
+				idx++;
+				break;
+			}
+			group->n_real_words++;
+
+			if ((idx + 1) < priv->words_len && sr_is_paragraph_sign(priv->words[idx + 1]))
+			{	/* paragraph sign in the next group, so move it to this group */
+				g_string_append(str, word);
+				g_string_append_unichar(str, 182);
+				group->weight += sr_word_weight(priv->words[idx + 1]);
+				group->n_words++;
+				idx += 2;
+				break;
+			}
+			else
+			{
+				g_string_append(str, word);
+				if (i < (priv->group_size - 1))
+					g_string_append_c(str, ' ');
+			}
+		}
+		idx++;
+	}
+	group->end = MIN(idx, priv->words_len);
+
+	/* the group ended early, so remove the separator */
+	while (str->len > 0 && str->str[str->len - 1] == ' ')
+		g_string_truncate(str, str->len - 1);
+}
+
+
+/* Returns the byte offset of the optimal recognition point of a word, that is the letter
+ * the eye should fixate. It is slightly left of the centre of the word. */
+static gint sr_orp_offset(const gchar *word)
 {
+	glong len = g_utf8_strlen(word, -1);
+	glong pos;
+
+	if (len <= 1)
+		pos = 0;
+	else if (len <= 5)
+		pos = 1;
+	else if (len <= 9)
+		pos = 2;
+	else if (len <= 13)
+		pos = 3;
+	else
+		pos = 4;
+
+	return g_utf8_offset_to_pointer(word, pos) - word;
+}
+
+
+/* Builds the group starting at idx and shapes its text, so that displaying it later
+ * requires no layout work at all */
+static SrGroup *sr_group_new(XfdSpeedReader *dialog, guint idx)
+{
+	SrGroup *group = g_new0(SrGroup, 1);
 	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
 
-	if (NZV(priv->group->str))
-		gtk_label_set_text(GTK_LABEL(priv->display_label), priv->group->str);
 	g_string_erase(priv->group, 0, -1);
+	sr_collect_group(priv, idx, priv->group, group);
+
+	group->layout = gtk_widget_create_pango_layout(priv->display, priv->group->str);
+	if (priv->font != NULL)
+		pango_layout_set_font_description(group->layout, priv->font);
+
+	if (priv->group_size == 1 && priv->group->len > 0)
+	{
+		/* highlight the recognition point and align the word at it */
+		PangoAttrList *attrs = pango_attr_list_new();
+		PangoAttribute *attr = pango_attr_foreground_new(0xcccc, 0, 0);
+		PangoRectangle rect;
+		gint orp = sr_orp_offset(priv->group->str);
+
+		attr->start_index = orp;
+		attr->end_index = g_utf8_next_char(priv->group->str + orp) - priv->group->str;
+		pango_attr_list_insert(attrs, attr);
+		pango_layout_set_attributes(group->layout, attrs);
+		pango_attr_list_unref(attrs);
+
+		pango_layout_index_to_pos(group->layout, orp, &rect);
+		group->orp_x = (rect.x + rect.width / 2) / PANGO_SCALE;
+	}
+	else
+	{
+		gint width;
+
+		pango_layout_get_pixel_size(group->layout, &width, NULL);
+		group->orp_x = width / 2;
+	}
+
+	return group;
+}
+
+
+static void sr_group_free(SrGroup *group)
+{
+	if (group == NULL)
+		return;
+
+	g_object_unref(group->layout);
+	g_free(group);
+}
+
+
+static void sr_clear_ahead(XfdSpeedReaderPrivate *priv)
+{
+	SrGroup *group;
+
+	while ((group = g_queue_pop_head(priv->ahead)) != NULL)
+		sr_group_free(group);
+}
+
+
+static gboolean sr_prepare_ahead(gpointer data)
+{
+	SrGroup *group, *last;
+	guint idx;
+	XfdSpeedReader *dialog = XFD_SPEED_READER(data);
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	priv->prepare_id = 0;
+
+	while (priv->words != NULL && g_queue_get_length(priv->ahead) < SR_GROUPS_AHEAD)
+	{
+		last = g_queue_peek_tail(priv->ahead);
+		idx = (last != NULL) ? last->end : priv->word_idx;
+		if (idx >= priv->words_len)
+			break;
+
+		group = sr_group_new(dialog, idx);
+		if (group->n_words == 0)
+		{	/* only empty elements left */
+			sr_group_free(group);
+			break;
+		}
+		g_queue_push_tail(priv->ahead, group);
+	}
+
+	return FALSE;
+}
+
+
+/* Lays out the next groups when the main loop is idle, i.e. right after a group was
+ * displayed and long before the next one is due */
+static void sr_queue_prepare_ahead(XfdSpeedReader *dialog)
+{
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->prepare_id == 0)
+		priv->prepare_id = g_idle_add(sr_prepare_ahead, dialog);
+}
+
+
+/* Displays the next group and returns its total weight */
+static gdouble sr_next_group(XfdSpeedReader *dialog)
+{
+	SrGroup *group;
+	gdouble weight = 0.0;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	group = g_queue_pop_head(priv->ahead);
+	if (group == NULL) /* nothing prepared yet, e.g. after seeking */
+		group = sr_group_new(dialog, priv->word_idx);
+
+	priv->word_idx = group->end;
+	priv->words_shown += group->n_real_words;
+
+	if (group->n_words > 0)
+	{
+		priv->group_start = group->start;
+		weight = group->weight;
+		sr_group_free(priv->current);
+		priv->current = group;
+		/* the display has a fixed size, so this only redraws it */
+		gtk_widget_queue_draw(priv->display);
+	}
+	else
+		sr_group_free(group);
+
+	sr_queue_prepare_ahead(dialog);
+
+	return weight;
+}
+
+
+static gboolean sr_display_draw_cb(GtkWidget *widget, cairo_t *cr, XfdSpeedReader *dialog)
+{
+	GtkStyleContext *context;
+	GdkRGBA color;
+	gint width, height, text_height;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	context = gtk_widget_get_style_context(widget);
+	width = gtk_widget_get_allocated_width(widget);
+	height = gtk_widget_get_allocated_height(widget);
+
+	gtk_render_background(context, cr, 0, 0, width, height);
+
+	gtk_style_context_get_color(context, gtk_widget_get_state_flags(widget), &color);
+	gdk_cairo_set_source_rgba(cr, &color);
+
+	if (priv->group_size == 1)
+	{	/* fixation marks above and below the recognition point */
+		cairo_set_line_width(cr, 1.0);
+		cairo_move_to(cr, width / 2 + 0.5, 0);
+		cairo_line_to(cr, width / 2 + 0.5, height / 8);
+		cairo_move_to(cr, width / 2 + 0.5, height - height / 8);
+		cairo_line_to(cr, width / 2 + 0.5, height);
+		cairo_stroke(cr);
+	}
+
+	if (priv->current != NULL)
+	{
+		pango_layout_get_pixel_size(priv->current->layout, NULL, &text_height);
+		cairo_move_to(cr, width / 2 - priv->current->orp_x, (height - text_height) / 2);
+		pango_cairo_show_layout(cr, priv->current->layout);
+	}
+
+	return FALSE;
+}
+
+
+static void sr_position_changed_cb(GtkRange *range, XfdSpeedReader *dialog);
+
+static void sr_update_position_scale(XfdSpeedReader *dialog)
+{
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words_len == 0)
+		return;
+
+	g_signal_handlers_block_by_func(priv->scale_position, sr_position_changed_cb, dialog);
+	gtk_range_set_value(GTK_RANGE(priv->scale_position),
+		100.0 * priv->group_start / priv->words_len);
+	g_signal_handlers_unblock_by_func(priv->scale_position, sr_position_changed_cb, dialog);
+}
+
+
+static void sr_update_progress(XfdSpeedReader *dialog, gint64 now)
+{
+	gint64 elapsed;
+	gchar *text;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	sr_update_position_scale(dialog);
+
+	elapsed = priv->active_time + (now - priv->resume_time);
+	if (elapsed <= 0)
+		return;
+
+	text = g_strdup_printf(_("Measured: %.0f words per minute"),
+		(gdouble) priv->words_shown * 60 * G_USEC_PER_SEC / elapsed);
+	gtk_label_set_text(GTK_LABEL(priv->wpm_label), text);
+	g_free(text);
+
+	priv->wpm_update_time = now;
+}
+
+
+static gboolean sr_timer(gpointer data);
+
+/* Schedules the next tick for the absolute time in priv->next_deadline. The timeout is
+ * rounded up to whole milliseconds but as the deadlines are computed from the previous
+ * deadline and not from the time the timer actually fired, the error doesn't accumulate. */
+static void sr_schedule_next(XfdSpeedReader *dialog)
+{
+	gint64 delay;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	delay = priv->next_deadline - g_get_monotonic_time();
+	if (delay < 0)
+		delay = 0;
+
+	priv->timer_id = g_timeout_add_full(G_PRIORITY_HIGH, (guint) ((delay + 999) / 1000),
+		sr_timer, dialog, NULL);
 }
 
 
 static gboolean sr_timer(gpointer data)
 {
-	gsize i;
+	gdouble weight;
+	gint64 now, start = dict_stats_start();
 	XfdSpeedReader *dialog = XFD_SPEED_READER(data);
 	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
 
+	/* this is a one-shot source, the next one is added by sr_schedule_next() */
+	priv->timer_id = 0;
+
 	if (priv->paused)
-		return TRUE;
+		return FALSE;
 
 	if (priv->word_idx >= priv->words_len)
 	{
@@ -304,60 +721,317 @@ static gboolean sr_timer(gpointer data)
 		return FALSE;
 	}
 
-	for (i = 0; (i < priv->group_size) && (priv->word_idx < priv->words_len); i++)
+	weight = sr_next_group(dialog);
+
+	now = g_get_monotonic_time();
+	if (now - priv->wpm_update_time >= SR_WPM_UPDATE_INTERVAL)
+		sr_update_progress(dialog, now);
+
+	priv->next_deadline += (gint64) (weight * priv->word_interval);
+	if (priv->next_deadline < now - SR_MAX_LATENESS)
+		priv->next_deadline = now;
+
+	sr_schedule_next(dialog);
+	dict_stats_end(DICT_STATS_SPEEDREADER_TICK, start);
+
+	return FALSE;
+}
+
+
+static void sr_show_group(XfdSpeedReader *dialog)
+{
+	sr_next_group(dialog);
+	sr_update_position_scale(dialog);
+}
+
+
+/* Continues reading at the given word. When running, the group is shown immediately and the
+ * timing continues from there, when paused only the display is updated. */
+static void sr_seek_to(XfdSpeedReader *dialog, guint word_idx)
+{
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words == NULL)
+		return;
+
+	priv->word_idx = MIN(word_idx, priv->words_len);
+	/* the prepared groups start at the old position */
+	sr_clear_ahead(priv);
+
+	if (priv->paused)
 	{
-		/* skip empty elements */
-		while (priv->word_idx < priv->words_len && ! NZV(priv->words[priv->word_idx]))
-			priv->word_idx++;
+		sr_show_group(dialog);
+	}
+	else
+	{
+		if (priv->timer_id > 0)
+			g_source_remove(priv->timer_id);
+		priv->next_deadline = g_get_monotonic_time();
+		sr_schedule_next(dialog);
+	}
+}
+
+
+static void sr_seek_sentence(XfdSpeedReader *dialog, gint delta)
+{
+	gint current, target;
+	guint start;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words == NULL || priv->sentence_starts->len == 0)
+		return;
+
+	current = priv->word_sentence[MIN(priv->group_start, priv->words_len - 1)];
+	/* going back from the middle of a sentence first goes to its start */
+	if (delta < 0 && priv->group_start > g_array_index(priv->sentence_starts, guint, current))
+		delta++;
+
+	target = CLAMP(current + delta, 0, (gint) priv->sentence_starts->len - 1);
+	start = g_array_index(priv->sentence_starts, guint, target);
+
+	sr_seek_to(dialog, start);
+}
+
+
+static void sr_seek_paragraph(XfdSpeedReader *dialog, gint delta)
+{
+	gint current, target;
+	guint start;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words == NULL || priv->paragraph_starts->len == 0)
+		return;
+
+	current = priv->word_paragraph[MIN(priv->group_start, priv->words_len - 1)];
+	if (delta < 0 && priv->group_start > g_array_index(priv->paragraph_starts, guint, current))
+		delta++;
+
+	target = CLAMP(current + delta, 0, (gint) priv->paragraph_starts->len - 1);
+	start = g_array_index(priv->paragraph_starts, guint, target);
+
+	sr_seek_to(dialog, start);
+}
+
+
+/* Seeks to the start of the sentence containing the word at the given percentage of the text */
+static void sr_seek_percentage(XfdSpeedReader *dialog, gdouble percentage)
+{
+	guint word_idx;
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words == NULL || priv->words_len == 0)
+		return;
+
+	word_idx = MIN((guint) (percentage * priv->words_len / 100.0), priv->words_len - 1);
+	if (priv->sentence_starts->len > 0)
+		word_idx = g_array_index(priv->sentence_starts, guint, priv->word_sentence[word_idx]);
+
+	sr_seek_to(dialog, word_idx);
+}
+
+
+static void sr_position_changed_cb(GtkRange *range, XfdSpeedReader *dialog)
+{
+	sr_seek_percentage(dialog, gtk_range_get_value(range));
+}
+
+
+static void sr_seek_button_clicked_cb(GtkButton *button, XfdSpeedReader *dialog)
+{
+	gint delta = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(button), "delta"));
+
+	if (g_object_get_data(G_OBJECT(button), "paragraph") != NULL)
+		sr_seek_paragraph(dialog, delta);
+	else
+		sr_seek_sentence(dialog, delta);
+}
+
+
+static gboolean sr_key_press_cb(GtkWidget *widget, GdkEventKey *event, XfdSpeedReader *dialog)
+{
+	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
+
+	if (priv->words == NULL)
+		return FALSE;
+
+	switch (event->keyval)
+	{
+		case GDK_KEY_Left:
+			sr_seek_sentence(dialog, -1);
+			return TRUE;
+		case GDK_KEY_Right:
+			sr_seek_sentence(dialog, 1);
+			return TRUE;
+		case GDK_KEY_Page_Up:
+			sr_seek_paragraph(dialog, -1);
+			return TRUE;
+		case GDK_KEY_Page_Down:
+			sr_seek_paragraph(dialog, 1);
+			return TRUE;
+		case GDK_KEY_Home:
+			sr_seek_to(dialog, 0);
+			return TRUE;
+	}
 
-		if (priv->word_idx < priv->words_len)
+	return FALSE;
+}
+
+
+/* Reading positions are remembered per text, identified by a hash of the text, so that long
+ * texts can be continued later. Only the last SR_MAX_BOOKMARKS texts are remembered. */
+static guint sr_bookmark_load(const gchar *text_hash, gsize words_len)
+{
+	XfceRc *rc;
+	guint position = 0;
+
+	rc = xfce_rc_config_open(XFCE_RESOURCE_CONFIG, SR_BOOKMARKS_FILE, TRUE);
+	if (rc == NULL)
+		return 0;
+
+	if (xfce_rc_has_group(rc, text_hash))
+	{
+		xfce_rc_set_group(rc, text_hash);
+		/* ignore the bookmark if the text was tokenised differently */
+		if ((gsize) xfce_rc_read_int_entry(rc, "words", 0) == words_len)
+			position = xfce_rc_read_int_entry(rc, "position", 0);
+	}
+	xfce_rc_close(rc);
+
+	return position;
+}
+
+
+static void sr_bookmark_save(const gchar *text_hash, gsize words_len, guint position)
+{
+	XfceRc *rc;
+	gchar **groups;
+	gchar *oldest = NULL;
+	gchar *stamp;
+	gint64 oldest_time = G_MAXINT64;
+	guint i, count = 0;
+
+	rc = xfce_rc_config_open(XFCE_RESOURCE_CONFIG, SR_BOOKMARKS_FILE, FALSE);
+	if (rc == NULL)
+		return;
+
+	/* a finished text doesn't need a bookmark anymore */
+	if (position == 0 || position >= words_len)
+	{
+		if (xfce_rc_has_group(rc, text_hash))
+			xfce_rc_delete_group(rc, text_hash, FALSE);
+		xfce_rc_close(rc);
+		return;
+	}
+
+	if (! xfce_rc_has_group(rc, text_hash))
+	{
+		/* make room for the new bookmark by removing the least recently used one */
+		groups = xfce_rc_get_groups(rc);
+		for (i = 0; groups != NULL && groups[i] != NULL; i++)
 		{
-			if (g_utf8_get_char(priv->words[priv->word_idx]) == 182)
-			{	/* paragraph sign inside the group */
-				g_string_append_unichar(priv->group, 182);
-				sr_set_label_text(data);
-				priv->word_idx++;
-				return TRUE;
-			}
-			if ((priv->word_idx + 1) < priv->words_len &&
-				g_utf8_get_char(priv->words[priv->word_idx + 1]) == 182)
-			{	/* paragraph sign in the next group, so move it to this group */
-				g_string_append(priv->group, priv->words[priv->word_idx]);
-				g_string_append_unichar(priv->group, 182);
-				sr_set_label_text(data);
-				priv->word_idx += 2;
-				return TRUE;
+			gint64 used;
+
+			if (strlen(groups[i]) != strlen(text_hash))
+				continue; /* not a bookmark, e.g. the default group */
+
+			count++;
+			xfce_rc_set_group(rc, groups[i]);
+			used = g_ascii_strtoll(xfce_rc_read_entry(rc, "time", "0"), NULL, 10);
+			if (used < oldest_time)
+			{
+				oldest_time = used;
+				g_free(oldest);
+				oldest = g_strdup(groups[i]);
 			}
-			else
+		}
+		if (count >= SR_MAX_BOOKMARKS && oldest != NULL)
+			xfce_rc_delete_group(rc, oldest, FALSE);
+
+		g_free(oldest);
+		g_strfreev(groups);
+	}
+
+	xfce_rc_set_group(rc, text_hash);
+	xfce_rc_write_int_entry(rc, "words", words_len);
+	xfce_rc_write_int_entry(rc, "position", position);
+	stamp = g_strdup_printf("%" G_GINT64_FORMAT, g_get_real_time() / G_USEC_PER_SEC);
+	xfce_rc_write_entry(rc, "time", stamp);
+	g_free(stamp);
+
+	xfce_rc_close(rc);
+}
+
+
+/* Builds the sentence index and the word to sentence/paragraph maps for O(1) seeking and
+ * returns the sum of all word weights. */
+static gdouble sr_build_index(XfdSpeedReaderPrivate *priv, gsize *n_words)
+{
+	guint i;
+	guint paragraph = 0;
+	gboolean sentence_start = TRUE;
+	gdouble total_weight = 0.0;
+	const gchar *word;
+	gunichar last;
+
+	priv->word_sentence = g_new0(guint, priv->words_len + 1);
+	priv->word_paragraph = g_new0(guint, priv->words_len + 1);
+	*n_words = 0;
+
+	for (i = 0; i < priv->words_len; i++)
+	{
+		word = priv->words[i];
+
+		if (paragraph < priv->paragraph_starts->len &&
+			g_array_index(priv->paragraph_starts, guint, paragraph) == i)
+		{
+			paragraph++;
+			sentence_start = TRUE;
+		}
+
+		if (NZV(word))
+		{
+			total_weight += sr_word_weight(word);
+			/* the paragraph signs take display time but are no words of the chosen rate */
+			if (! sr_is_paragraph_sign(word))
+				(*n_words)++;
+
+			if (sentence_start && ! sr_is_paragraph_sign(word))
 			{
-				g_string_append(priv->group, priv->words[priv->word_idx]);
-				if (i < (priv->group_size - 1))
-					g_string_append_c(priv->group, ' ');
+				g_array_append_val(priv->sentence_starts, i);
+				sentence_start = FALSE;
 			}
+
+			last = g_utf8_get_char(g_utf8_find_prev_char(word, word + strlen(word)));
+			if (last == '.' || last == '!' || last == '?' || sr_is_paragraph_sign(word))
+				sentence_start = TRUE;
 		}
-		priv->word_idx++;
+
+		priv->word_sentence[i] = MAX(priv->sentence_starts->len, 1) - 1;
+		priv->word_paragraph[i] = MAX(paragraph, 1) - 1;
 	}
-	sr_set_label_text(data);
 
-	return TRUE;
+	return total_weight;
 }
 
 
 static void sr_start(XfdSpeedReader *dialog)
 {
 	gint wpm, grouping;
-	gint interval;
+	gsize n_words;
+	guint position;
+	gdouble total_weight;
 	gchar *fontname;
 	gchar *text, *cleaned_text;
 	GtkTextIter start, end;
-	gchar *css;
-	GtkCssProvider *provider;
-	PangoFontDescription *font;
+	PangoLayout *layout;
+	gint height;
 
 	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
 
-	/* clear the label text */
-	gtk_label_set_text(GTK_LABEL(priv->display_label), NULL);
+	/* clear the display */
+	sr_group_free(priv->current);
+	priv->current = NULL;
+	gtk_widget_queue_draw(priv->display);
 
 	/* get the text */
 	gtk_text_buffer_get_start_iter(GTK_TEXT_BUFFER(priv->buffer), &start);
@@ -378,39 +1052,27 @@ static void sr_start(XfdSpeedReader *dialog)
 
 	/* set the font */
 	fontname = gtk_font_chooser_get_font(GTK_FONT_CHOOSER(priv->button_font));
-	font = pango_font_description_from_string(fontname);
-
-	if (G_LIKELY (font))
-	{
-		css = g_strdup_printf("label { font-family: %s; font-size: %dpx; font-style: %s; font-weight: %s }",
-													pango_font_description_get_family (font),
-													pango_font_description_get_size (font) / PANGO_SCALE,
-													(pango_font_description_get_style(font) == PANGO_STYLE_ITALIC ||
-													pango_font_description_get_style(font) == PANGO_STYLE_OBLIQUE) ? "italic" : "normal",
-													(pango_font_description_get_weight(font) >= PANGO_WEIGHT_BOLD) ? "bold" : "normal");
-		pango_font_description_free (font);
-	}
-	else
-		css = g_strdup_printf("* { font: %s; }", fontname);
-
-	provider = gtk_css_provider_new ();
-	gtk_css_provider_load_from_data (provider, css, -1, NULL);
-	gtk_style_context_add_provider (
-			GTK_STYLE_CONTEXT (gtk_widget_get_style_context (GTK_WIDGET (priv->display_label))),
-			GTK_STYLE_PROVIDER(provider),
-			GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-	g_free(css);
+	if (priv->font != NULL)
+		pango_font_description_free(priv->font);
+	priv->font = pango_font_description_from_string(fontname);
 
 	/* word grouping */
 	grouping = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(priv->spin_grouping));
 	if (grouping >= 1 && grouping < 100) /* paranoia */
 		priv->group_size = grouping;
 
+	/* give the display a fixed height for the chosen font so that it never needs to be
+	 * resized while reading */
+	layout = gtk_widget_create_pango_layout(priv->display, "Mg");
+	pango_layout_set_font_description(layout, priv->font);
+	pango_layout_get_pixel_size(layout, NULL, &height);
+	gtk_widget_set_size_request(priv->display, -1, height * 2);
+	g_object_unref(layout);
+
 	/* calculate the rate */
 	wpm = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(priv->spin_wpm));
 	if (wpm < 1)
 		wpm = 400;
-	interval = 60000 / wpm;
 
 	/* save the settings */
 	priv->dd->speedreader_wpm = wpm;
@@ -423,10 +1085,45 @@ static void sr_start(XfdSpeedReader *dialog)
 	priv->group = g_string_new(NULL);
 	/* replace Unicode dashes and spaces and mark paragraphs */
 	cleaned_text = sr_replace_unicode_characters(text, priv->dd->speedreader_mark_paragraphs);
-	priv->words = sr_strsplit_set(cleaned_text, " -_=\t\n\r");
+	priv->paragraph_starts = g_array_new(FALSE, FALSE, sizeof(guint));
+	priv->sentence_starts = g_array_new(FALSE, FALSE, sizeof(guint));
+	priv->words = sr_strsplit_set(cleaned_text, " -_=\t\n\r", priv->paragraph_starts);
 	priv->words_len = g_strv_length(priv->words);
+	total_weight = sr_build_index(priv, &n_words);
+
+	/* continue where we stopped reading this text the last time */
+	priv->text_hash = g_compute_checksum_for_string(G_CHECKSUM_SHA1, text, -1);
+	position = sr_bookmark_load(priv->text_hash, priv->words_len);
+	if (position > 0 && position < priv->words_len)
+	{
+		priv->word_idx = g_array_index(priv->sentence_starts, guint, priv->word_sentence[position]);
+		priv->group_start = priv->word_idx;
+	}
+	else
+		priv->group_start = 0;
+
+	/* scale the per word display time so that the average rate matches the chosen
+	 * rate even though single words are shown shorter or longer */
+	priv->word_interval = 60.0 * G_USEC_PER_SEC / wpm;
+	if (total_weight > 0.0)
+		priv->word_interval *= n_words / total_weight;
+
+	priv->words_shown = 0;
+	priv->active_time = 0;
+	priv->resume_time = priv->next_deadline = priv->wpm_update_time = g_get_monotonic_time();
+	if (priv->group_start > 0)
+	{
+		gchar *msg = g_strdup_printf(_("Continuing at %d%%"),
+			(gint) (100.0 * priv->group_start / priv->words_len));
+		gtk_label_set_text(GTK_LABEL(priv->wpm_label), msg);
+		g_free(msg);
+	}
+	else
+		gtk_label_set_text(GTK_LABEL(priv->wpm_label), NULL);
+	sr_update_position_scale(dialog);
 
-	priv->timer_id = g_timeout_add(interval, sr_timer, dialog);
+	sr_prepare_ahead(dialog);
+	sr_schedule_next(dialog);
 	sr_pause(dialog, FALSE);
 
 	g_free(text);
@@ -443,11 +1140,36 @@ static void sr_stop_timer(XfdSpeedReader *dialog)
 	{
 		g_source_remove(priv->timer_id);
 		priv->timer_id = 0;
+	}
+	if (priv->prepare_id > 0)
+	{
+		g_source_remove(priv->prepare_id);
+		priv->prepare_id = 0;
+	}
+	if (priv->words != NULL)
+	{
+		/* remember the position to continue there next time */
+		sr_bookmark_save(priv->text_hash, priv->words_len,
+			(priv->word_idx >= priv->words_len) ? priv->words_len : priv->group_start);
 
 		g_string_free(priv->group, TRUE);
 		priv->group = NULL;
 		g_strfreev(priv->words);
 		priv->words = NULL;
+		g_array_free(priv->sentence_starts, TRUE);
+		priv->sentence_starts = NULL;
+		g_array_free(priv->paragraph_starts, TRUE);
+		priv->paragraph_starts = NULL;
+		g_free(priv->word_sentence);
+		priv->word_sentence = NULL;
+		g_free(priv->word_paragraph);
+		priv->word_paragraph = NULL;
+		g_free(priv->text_hash);
+		priv->text_hash = NULL;
+
+		sr_clear_ahead(priv);
+		sr_group_free(priv->current);
+		priv->current = NULL;
 	}
 }
 
@@ -476,6 +1198,22 @@ static void sr_pause(XfdSpeedReader *dialog, gboolean paused)
 			gtk_image_new_from_icon_name("media-playback-pause", GTK_ICON_SIZE_MENU));
 		gtk_button_set_label(GTK_BUTTON(priv->button_pause), XFD_TITLE_PAUSE);
 	}
+
+	if (paused && ! priv->paused && priv->words != NULL)
+	{
+		if (priv->timer_id > 0)
+		{
+			g_source_remove(priv->timer_id);
+			priv->timer_id = 0;
+		}
+		priv->active_time += g_get_monotonic_time() - priv->resume_time;
+	}
+	else if (! paused && priv->paused && priv->words != NULL)
+	{
+		/* continue with a fresh deadline, the pause must not be made up for */
+		priv->resume_time = priv->next_deadline = g_get_monotonic_time();
+		sr_schedule_next(dialog);
+	}
 	/* set the new value */
 	priv->paused = paused;
 }
@@ -592,7 +1330,21 @@ static void xfd_speed_reader_init(XfdSpeedReader *dialog)
 	GtkWidget *label_intro, *label_words, *label_font, *label_grouping, *label_grouping_desc;
 	GtkWidget *vbox, *hbox_words, *hbox_font, *hbox_grouping, *swin, *textview;
 	GtkWidget *vbox_text_buttons, *hbox_text, *button_clear, *button_paste, *button_open, *button_close;
+	GtkWidget *hbox_seek, *button;
 	GtkSizeGroup *sizegroup;
+	guint i;
+	const struct
+	{
+		const gchar *icon;
+		const gchar *tooltip;
+		gint delta;
+		gboolean paragraph;
+	} seek_buttons[] = {
+		{ "go-first", N_("Previous paragraph (Page Up)"), -1, TRUE },
+		{ "media-seek-backward", N_("Previous sentence (Left)"), -1, FALSE },
+		{ "media-seek-forward", N_("Next sentence (Right)"), 1, FALSE },
+		{ "go-last", N_("Next paragraph (Page Down)"), 1, TRUE }
+	};
 	XfdSpeedReaderPrivate *priv = xfd_speed_reader_get_instance_private(dialog);
 
 	gtk_window_set_destroy_with_parent(GTK_WINDOW(dialog), TRUE);
@@ -721,11 +1473,46 @@ static void xfd_speed_reader_init(XfdSpeedReader *dialog)
 	priv->first_page = vbox;
 
 	/* Second page */
-	priv->display_label = gtk_label_new(NULL);
-	gtk_widget_show(priv->display_label);
+	priv->ahead = g_queue_new();
+	priv->display = gtk_drawing_area_new();
+	g_signal_connect(priv->display, "draw", G_CALLBACK(sr_display_draw_cb), dialog);
+	gtk_widget_show(priv->display);
+
+	priv->wpm_label = gtk_label_new(NULL);
+	gtk_widget_set_halign(priv->wpm_label, GTK_ALIGN_END);
+	gtk_widget_show(priv->wpm_label);
+
+	/* navigation */
+	hbox_seek = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 3);
+	for (i = 0; i < G_N_ELEMENTS(seek_buttons); i++)
+	{
+		button = gtk_button_new_from_icon_name(seek_buttons[i].icon, GTK_ICON_SIZE_MENU);
+		gtk_widget_set_tooltip_text(button, _(seek_buttons[i].tooltip));
+		gtk_widget_set_can_focus(button, FALSE);
+		g_object_set_data(G_OBJECT(button), "delta", GINT_TO_POINTER(seek_buttons[i].delta));
+		if (seek_buttons[i].paragraph)
+			g_object_set_data(G_OBJECT(button), "paragraph", GINT_TO_POINTER(TRUE));
+		g_signal_connect(button, "clicked", G_CALLBACK(sr_seek_button_clicked_cb), dialog);
+		gtk_box_pack_start(GTK_BOX(hbox_seek), button, FALSE, FALSE, 0);
+		/* the position scale goes between the backward and forward buttons */
+		if (i == 1)
+		{
+			priv->scale_position = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0.0, 100.0, 1.0);
+			gtk_scale_set_draw_value(GTK_SCALE(priv->scale_position), FALSE);
+			gtk_widget_set_can_focus(priv->scale_position, FALSE);
+			g_signal_connect(priv->scale_position, "value-changed",
+				G_CALLBACK(sr_position_changed_cb), dialog);
+			gtk_box_pack_start(GTK_BOX(hbox_seek), priv->scale_position, TRUE, TRUE, 0);
+		}
+	}
+	gtk_widget_show_all(hbox_seek);
+
+	g_signal_connect(dialog, "key-press-event", G_CALLBACK(sr_key_press_cb), dialog);
 
 	vbox = gtk_box_new (GTK_ORIENTATION_VERTICAL, 6);
-	gtk_box_pack_start(GTK_BOX(vbox), priv->display_label, TRUE, TRUE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), priv->display, TRUE, TRUE, 6);
+	gtk_box_pack_start(GTK_BOX(vbox), hbox_seek, FALSE, FALSE, 0);
+	gtk_box_pack_start(GTK_BOX(vbox), priv->wpm_label, FALSE, FALSE, 0);
 
 	priv->second_page = vbox;
 
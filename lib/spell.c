@@ -35,12 +35,14 @@
 #include "common.h"
 #include "spell.h"
 #include "gui.h"
+#include "stats.h"
 
 
 typedef struct
 {
 	DictData *dd;
 	gchar *word;
+	guint search_id;
 	gboolean quiet;
 	gboolean header_printed;
 } iodata;
@@ -85,6 +87,18 @@ static gboolean iofunc_read(GIOChannel *ioc, GIOCondition cond, gpointer data)
 		gchar *msg, *tmp;
 		DictData *dd = iod->dd;
 
+		/* another search was started or other results were shown in the meantime, the
+		 * output is still read to let the process finish */
+		if (iod->search_id != dd->search_id)
+		{
+			while (g_io_channel_read_line(ioc, &msg, NULL, NULL, NULL) && msg != NULL)
+				g_free(msg);
+			return TRUE;
+		}
+
+		/* other backends may have inserted text since the last call */
+		dict_gui_section_get_iter(dd, DICT_SECTION_SPELL);
+
 		while (g_io_channel_read_line(ioc, &msg, NULL, NULL, NULL) && msg != NULL)
 		{
 			if (msg[0] == '&')
@@ -194,6 +208,7 @@ void dict_spell_start_query(DictData *dd, const gchar *word, gboolean quiet)
 	gchar  **tts; /* text to search */
 	gboolean header_printed = FALSE;
 	iodata	*iod;
+	gint64	 start;
 
 	if (! NZV(dd->spell_bin))
 	{
@@ -223,14 +238,17 @@ void dict_spell_start_query(DictData *dd, const gchar *word, gboolean quiet)
 		argv[3] = g_strdup(dd->spell_dictionary);
 		argv[4] = NULL;
 
+		start = dict_stats_start();
 		if (g_spawn_async_with_pipes(NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, NULL,
 				&stdin_fd, &stdout_fd, &stderr_fd, &error))
 		{
+			dict_stats_end(DICT_STATS_SPELL_SPAWN, start);
 			iod = g_new(iodata, 1);
 			/* if we have more than one search term, show them all even if in quiet mode */
 			iod->quiet = quiet && (tts_len == 1);
 			iod->dd = dd;
 			iod->word = g_strdup(tts[i]);
+			iod->search_id = dd->search_id;
 			iod->header_printed = header_printed;
 
 			set_up_io_channel(stdin_fd, G_IO_OUT, iofunc_write, g_strdup(tts[i]));
@@ -0,0 +1,217 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* Timing probes for the phases of lookups, spell checks and the speed reader. The
+ * recent samples of each probe are kept in a ring buffer of its own for percentiles, so
+ * frequent probes like the speed reader ticks don't push out the lookup samples. All
+ * samples are counted in histograms with power of two buckets. The probes may be used
+ * from any thread. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+
+/* number of recent samples kept per probe for the percentiles */
+#define DICT_STATS_RING_SIZE	1024
+/* bucket n counts durations up to 2^n microseconds, the last one everything longer */
+#define DICT_STATS_N_BUCKETS	24
+
+
+typedef struct
+{
+	gint64 durations[DICT_STATS_RING_SIZE];
+	guint pos;
+	guint len;
+} DictStatsRing;
+
+typedef struct
+{
+	guint count;
+	guint64 total;
+	guint64 max;
+	guint64 buckets[DICT_STATS_N_BUCKETS];
+} DictStatsHistogram;
+
+
+static const gchar *probe_names[DICT_STATS_N_PROBES] =
+{
+	"resolve",
+	"connect",
+	"banner",
+	"request",
+	"first-byte",
+	"last-byte",
+	"parse",
+	"render",
+	"spell-spawn",
+	"speedreader-tick"
+};
+
+static DictStatsRing rings[DICT_STATS_N_PROBES];
+static DictStatsHistogram histograms[DICT_STATS_N_PROBES];
+G_LOCK_DEFINE_STATIC(stats);
+
+
+void dict_stats_add(DictStatsProbe probe, gint64 duration)
+{
+	DictStatsHistogram *hist = &histograms[probe];
+	DictStatsRing *ring = &rings[probe];
+	guint bucket = 0;
+
+	if (duration < 0)
+		duration = 0;
+	while (bucket < DICT_STATS_N_BUCKETS - 1 && duration > ((gint64) 1 << bucket))
+		bucket++;
+
+	G_LOCK(stats);
+	ring->durations[ring->pos] = duration;
+	ring->pos = (ring->pos + 1) % DICT_STATS_RING_SIZE;
+	if (ring->len < DICT_STATS_RING_SIZE)
+		ring->len++;
+
+	hist->count++;
+	hist->total += duration;
+	hist->max = MAX(hist->max, (guint64) duration);
+	hist->buckets[bucket]++;
+	G_UNLOCK(stats);
+}
+
+
+/* Adds the time since 'start' which was returned by dict_stats_start() */
+void dict_stats_end(DictStatsProbe probe, gint64 start)
+{
+	dict_stats_add(probe, g_get_monotonic_time() - start);
+}
+
+
+void dict_stats_reset(void)
+{
+	G_LOCK(stats);
+	memset(rings, 0, sizeof(rings));
+	memset(histograms, 0, sizeof(histograms));
+	G_UNLOCK(stats);
+}
+
+
+static gint compare_durations(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+/* Computes the median and the 99th percentile of the recent samples of the probe,
+ * has to be called with the lock held */
+static void stats_percentiles(DictStatsProbe probe, guint64 *p50, guint64 *p99)
+{
+	DictStatsRing *ring = &rings[probe];
+	gint64 durations[DICT_STATS_RING_SIZE];
+	guint n = ring->len;
+
+	if (n == 0)
+	{
+		*p50 = *p99 = 0;
+		return;
+	}
+	/* sorted in a copy, the ring keeps the order of the samples */
+	memcpy(durations, ring->durations, n * sizeof(gint64));
+	qsort(durations, n, sizeof(gint64), compare_durations);
+	*p50 = durations[n / 2];
+	*p99 = durations[MIN(n - 1, n * 99 / 100)];
+}
+
+
+/* Returns the statistics of all probes as a(suttttat): name, number of samples, total,
+ * maximum, median and 99th percentile of the recent samples (all in microseconds) and
+ * the histogram. Bucket n of the histogram counts the durations up to 2^n microseconds. */
+GVariant *dict_stats_get_variant(void)
+{
+	GVariantBuilder builder, buckets;
+	DictStatsHistogram *hist;
+	guint64 p50, p99;
+	guint i, j;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(suttttat)"));
+
+	G_LOCK(stats);
+	for (i = 0; i < DICT_STATS_N_PROBES; i++)
+	{
+		hist = &histograms[i];
+		stats_percentiles(i, &p50, &p99);
+
+		g_variant_builder_init(&buckets, G_VARIANT_TYPE("at"));
+		for (j = 0; j < DICT_STATS_N_BUCKETS; j++)
+			g_variant_builder_add(&buckets, "t", hist->buckets[j]);
+
+		g_variant_builder_add(&builder, "(suttttat)", probe_names[i], hist->count,
+			hist->total, hist->max, p50, p99, &buckets);
+	}
+	G_UNLOCK(stats);
+
+	return g_variant_builder_end(&builder);
+}
+
+
+/* Prints the statistics of all probes with at least one sample, for --verbose */
+void dict_stats_print(void)
+{
+	DictStatsHistogram *hist;
+	GString *str = g_string_sized_new(256);
+	guint64 p50, p99;
+	guint i, j;
+
+	G_LOCK(stats);
+	for (i = 0; i < DICT_STATS_N_PROBES; i++)
+	{
+		hist = &histograms[i];
+		if (hist->count == 0)
+			continue;
+
+		stats_percentiles(i, &p50, &p99);
+		g_string_printf(str, "%-16s %6u samples, mean %.3f ms, p50 %.3f ms, p99 %.3f ms, max %.3f ms",
+			probe_names[i], hist->count, hist->total / (hist->count * 1000.0),
+			p50 / 1000.0, p99 / 1000.0, hist->max / 1000.0);
+
+		/* the histogram as "<=bucket limit: count" for all non-empty buckets */
+		g_string_append(str, "\n                 ");
+		for (j = 0; j < DICT_STATS_N_BUCKETS; j++)
+		{
+			if (hist->buckets[j] == 0)
+				continue;
+			if (j == DICT_STATS_N_BUCKETS - 1)
+				g_string_append_printf(str, " >%.3fms: %" G_GUINT64_FORMAT,
+					((guint64) 1 << (j - 1)) / 1000.0, hist->buckets[j]);
+			else
+				g_string_append_printf(str, " <=%.3fms: %" G_GUINT64_FORMAT,
+					((guint64) 1 << j) / 1000.0, hist->buckets[j]);
+		}
+		g_message("%s", str->str);
+	}
+	G_UNLOCK(stats);
+
+	g_string_free(str, TRUE);
+}
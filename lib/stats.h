@@ -0,0 +1,51 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef STATS_H
+#define STATS_H 1
+
+#include <glib.h>
+
+
+typedef enum
+{
+	DICT_STATS_RESOLVE,		/* looking up the server address */
+	DICT_STATS_CONNECT,
+	DICT_STATS_BANNER,		/* waiting for the server's greeting */
+	DICT_STATS_REQUEST,		/* sending a command */
+	DICT_STATS_FIRST_BYTE,	/* from the sent command to the first byte of the reply */
+	DICT_STATS_LAST_BYTE,	/* from the sent command to the end of the reply */
+	DICT_STATS_PARSE,
+	DICT_STATS_RENDER,
+	DICT_STATS_SPELL_SPAWN,
+	DICT_STATS_SPEEDREADER_TICK,
+	DICT_STATS_N_PROBES
+} DictStatsProbe;
+
+
+/* Returns the start time for dict_stats_end() */
+#define dict_stats_start() g_get_monotonic_time()
+
+void dict_stats_add(DictStatsProbe probe, gint64 duration);
+void dict_stats_end(DictStatsProbe probe, gint64 start);
+GVariant *dict_stats_get_variant(void);
+void dict_stats_print(void);
+void dict_stats_reset(void);
+
+
+#endif
@@ -0,0 +1,297 @@
+/*  Copyright 2006-2011 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+/* Tests for the RFC 2229 parser, run by "make check". The replies are recorded from
+ * dict.org and the GNU dictd, shortened where the rest would not test anything more. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "dictparser.h"
+
+
+#define REPLY_DEFINE \
+	"150 1 definitions retrieved\r\n" \
+	"151 \"cat\" wn \"WordNet (r) 3.0 (2006)\"\r\n" \
+	"cat\r\n" \
+	"    n 1: feline mammal usually having thick soft fur and no ability\r\n" \
+	"         to roar: domestic cats; wildcats [syn: {true cat}, {cat}]\r\n" \
+	".\r\n" \
+	"250 ok [d/m/c = 1/0/20; 0.000r 0.000u 0.000s]\r\n"
+
+/* the period of ".NET" is masked by doubling it, the empty line must be kept */
+#define REPLY_MASKED \
+	"150 1 definitions retrieved\r\n" \
+	"151 \".NET\" foldoc \"The Free On-line Dictionary of Computing (30 December 2018)\"\r\n" \
+	"..NET\r\n" \
+	"\r\n" \
+	"   <programming> Microsoft's {framework} for web services.\r\n" \
+	"..\r\n" \
+	"...\r\n" \
+	".\r\n" \
+	"250 ok [d/m/c = 1/0/12; 0.000r 0.000u 0.000s]\r\n"
+
+#define REPLY_MATCH \
+	"152 3 matches found\r\n" \
+	"wn \"cat\"\r\n" \
+	"wn \"cat-o'-nine-tails\"\r\n" \
+	"gcide \"Cat\"\r\n" \
+	".\r\n" \
+	"250 ok [d/m/c = 0/3/1015; 0.000r 0.000u 0.000s]\r\n"
+
+#define REPLY_NOT_FOUND \
+	"552 no match [d/m/c = 0/0/84; 0.000r 0.000u 0.000s]\r\n"
+
+#define REPLY_SHOW_DB \
+	"110 2 databases present\r\n" \
+	"gcide \"The Collaborative International Dictionary of English v.0.48\"\r\n" \
+	"wn \"WordNet (r) 3.0 (2006)\"\r\n" \
+	".\r\n" \
+	"250 ok\r\n"
+
+/* phonetics in the header, only the first format of a line counts, so the brackets are
+ * kept. Links in the body, {n} is no link and a brace is unmatched. */
+#define DEFINITION_MARKUP \
+	"Cat \\Cat\\ (k[a^]t), n. [AS. cat.]\n" \
+	"   1. (Zool.) Any {carnivore} of the family {Felidae}. {n}\n" \
+	"   2. A double {tripod. [Obs.]\n"
+
+
+static void test_define(void)
+{
+	DictReply *reply = dict_parser_parse(REPLY_DEFINE, -1);
+	DictDefinition *def;
+
+	g_assert_cmpint(reply->code, ==, 250);
+	g_assert_cmpuint(reply->definitions->len, ==, 1);
+	g_assert_cmpuint(reply->matches->len, ==, 0);
+	g_assert_cmpstr(reply->raw->str, ==, REPLY_DEFINE);
+
+	def = g_ptr_array_index(reply->definitions, 0);
+	g_assert_cmpstr(def->word, ==, "cat");
+	g_assert_cmpstr(def->database, ==, "wn");
+	g_assert_cmpstr(def->description, ==, "WordNet (r) 3.0 (2006)");
+	g_assert_cmpstr(def->definition, ==,
+		"cat\n"
+		"    n 1: feline mammal usually having thick soft fur and no ability\n"
+		"         to roar: domestic cats; wildcats [syn: {true cat}, {cat}]\n");
+
+	dict_reply_free(reply);
+}
+
+
+static void test_masked_period(void)
+{
+	DictReply *reply = dict_parser_parse(REPLY_MASKED, -1);
+	DictDefinition *def;
+
+	g_assert_cmpint(reply->code, ==, 250);
+	g_assert_cmpuint(reply->definitions->len, ==, 1);
+
+	def = g_ptr_array_index(reply->definitions, 0);
+	g_assert_cmpstr(def->word, ==, ".NET");
+	g_assert_cmpstr(def->definition, ==,
+		".NET\n"
+		"\n"
+		"   <programming> Microsoft's {framework} for web services.\n"
+		".\n"
+		"..\n");
+
+	dict_reply_free(reply);
+}
+
+
+static void test_match(void)
+{
+	DictReply *reply = dict_parser_parse(REPLY_MATCH, -1);
+	DictMatch *match;
+
+	g_assert_cmpint(reply->code, ==, 250);
+	g_assert_cmpuint(reply->matches->len, ==, 3);
+
+	match = g_ptr_array_index(reply->matches, 1);
+	g_assert_cmpstr(match->database, ==, "wn");
+	g_assert_cmpstr(match->word, ==, "cat-o'-nine-tails");
+	match = g_ptr_array_index(reply->matches, 2);
+	g_assert_cmpstr(match->database, ==, "gcide");
+	g_assert_cmpstr(match->word, ==, "Cat");
+
+	dict_reply_free(reply);
+}
+
+
+static void test_status_and_text(void)
+{
+	DictReply *reply;
+
+	reply = dict_parser_parse(REPLY_NOT_FOUND, -1);
+	g_assert_cmpint(reply->code, ==, 552);
+	g_assert_cmpuint(reply->definitions->len, ==, 0);
+	dict_reply_free(reply);
+
+	reply = dict_parser_parse(REPLY_SHOW_DB, -1);
+	g_assert_cmpint(reply->code, ==, 250);
+	g_assert_cmpstr(reply->text->str, ==,
+		"gcide \"The Collaborative International Dictionary of English v.0.48\"\n"
+		"wn \"WordNet (r) 3.0 (2006)\"\n");
+	dict_reply_free(reply);
+}
+
+
+/* The server closed the connection in the middle of the definition */
+static void test_incomplete(void)
+{
+	DictReply *reply = dict_parser_parse(REPLY_DEFINE, strstr(REPLY_DEFINE, ".\r\n") - REPLY_DEFINE);
+
+	g_assert_cmpint(reply->code, ==, -1);
+	g_assert_cmpuint(reply->definitions->len, ==, 0);
+
+	dict_reply_free(reply);
+}
+
+
+/* Replies to pipelined commands arrive back to back, the parser has to stop after the
+ * final status line of the first one */
+static void test_pipelined(void)
+{
+	const gchar *data = REPLY_MATCH REPLY_DEFINE REPLY_NOT_FOUND;
+	const gchar *replies[] = { REPLY_MATCH, REPLY_DEFINE, REPLY_NOT_FOUND };
+	const gint codes[] = { 250, 250, 552 };
+	DictParser *parser;
+	DictReply *reply;
+	gsize pos = 0, len = strlen(data);
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS(replies); i++)
+	{
+		parser = dict_parser_new();
+		pos += dict_parser_feed(parser, data + pos, len - pos);
+		g_assert_true(dict_parser_is_complete(parser));
+		reply = dict_parser_finish(parser);
+
+		g_assert_cmpint(reply->code, ==, codes[i]);
+		g_assert_cmpstr(reply->raw->str, ==, replies[i]);
+		dict_reply_free(reply);
+	}
+	g_assert_cmpuint(pos, ==, len);
+}
+
+
+/* A reply split into chunks of any size, also between CR and LF, is parsed like one
+ * received at once */
+static void test_split(void)
+{
+	const gchar *data = REPLY_MASKED;
+	DictParser *parser;
+	DictReply *expected, *reply;
+	DictDefinition *a, *b;
+	gsize chunk, pos, len = strlen(data);
+
+	expected = dict_parser_parse(data, len);
+	a = g_ptr_array_index(expected->definitions, 0);
+
+	for (chunk = 1; chunk < len; chunk++)
+	{
+		parser = dict_parser_new();
+		for (pos = 0; pos < len; pos += chunk)
+		{
+			g_assert_false(dict_parser_is_complete(parser));
+			g_assert_cmpuint(dict_parser_feed(parser, data + pos, MIN(chunk, len - pos)), ==,
+				MIN(chunk, len - pos));
+		}
+		g_assert_true(dict_parser_is_complete(parser));
+		reply = dict_parser_finish(parser);
+
+		g_assert_cmpint(reply->code, ==, expected->code);
+		g_assert_cmpstr(reply->raw->str, ==, data);
+		g_assert_cmpuint(reply->definitions->len, ==, 1);
+		b = g_ptr_array_index(reply->definitions, 0);
+		g_assert_cmpstr(b->word, ==, a->word);
+		g_assert_cmpstr(b->description, ==, a->description);
+		g_assert_cmpstr(b->definition, ==, a->definition);
+		dict_reply_free(reply);
+	}
+	dict_reply_free(expected);
+}
+
+
+static void check_span(GString *text, GArray *spans, guint i, DictSpanType type,
+					   const gchar *str)
+{
+	DictSpan *span = &g_array_index(spans, DictSpan, i);
+	gchar *spanned = g_strndup(text->str + span->start, span->len);
+
+	g_assert_cmpint(span->type, ==, type);
+	g_assert_cmpstr(spanned, ==, str);
+	g_free(spanned);
+}
+
+
+static void test_markup(void)
+{
+	GString *text = g_string_new("prefix ");
+	GArray *spans = g_array_new(FALSE, FALSE, sizeof(DictSpan));
+	DictArena *arena = dict_arena_new(0);
+	GString *text2 = g_string_new("prefix ");
+	GArray *spans2 = g_array_new(FALSE, FALSE, sizeof(DictSpan));
+
+	/* the offsets are relative to the start of the text, not to the definition */
+	dict_parser_markup(DEFINITION_MARKUP, text, spans, arena);
+	g_assert_cmpstr(text->str, ==,
+		"prefix Cat Cat (k[a^]t), n. [AS. cat.]\n"
+		"   1. (Zool.) Any carnivore of the family Felidae. {n}\n"
+		"   2. A double {tripod. [Obs.]\n");
+	g_assert_cmpuint(spans->len, ==, 3);
+	check_span(text, spans, 0, DICT_SPAN_PHONETIC, "Cat");
+	check_span(text, spans, 1, DICT_SPAN_LINK, "carnivore");
+	check_span(text, spans, 2, DICT_SPAN_LINK, "Felidae");
+
+	/* the result does not depend on where the temporary memory comes from */
+	dict_parser_markup(DEFINITION_MARKUP, text2, spans2, NULL);
+	g_assert_cmpstr(text2->str, ==, text->str);
+	g_assert_cmpuint(spans2->len, ==, spans->len);
+	g_assert_cmpint(memcmp(spans2->data, spans->data, spans->len * sizeof(DictSpan)), ==, 0);
+
+	dict_arena_free(arena);
+	g_string_free(text, TRUE);
+	g_string_free(text2, TRUE);
+	g_array_free(spans, TRUE);
+	g_array_free(spans2, TRUE);
+}
+
+
+gint main(gint argc, gchar *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/dictparser/define", test_define);
+	g_test_add_func("/dictparser/masked-period", test_masked_period);
+	g_test_add_func("/dictparser/match", test_match);
+	g_test_add_func("/dictparser/status-and-text", test_status_and_text);
+	g_test_add_func("/dictparser/incomplete", test_incomplete);
+	g_test_add_func("/dictparser/pipelined", test_pipelined);
+	g_test_add_func("/dictparser/split", test_split);
+	g_test_add_func("/dictparser/markup", test_markup);
+
+	return g_test_run();
+}
@@ -51,9 +51,15 @@ typedef struct
 	GtkWidget *panel_button;
 	GtkWidget *panel_button_image;
 	GtkWidget *box;
+
+	guint prebuild_source;
 } DictPanelData;
 
 
+/* seconds after the panel started until the main window is prepared, if enabled */
+#define DICT_PREBUILD_DELAY		30
+
+
 static gboolean entry_is_dirty = FALSE;
 
 
@@ -105,7 +111,7 @@ static gboolean dict_plugin_panel_set_size(XfcePanelPlugin *plugin, gint wsize,
 
 static void dict_plugin_panel_button_clicked(GtkWidget *button, DictPanelData *dpd)
 {
-	if (gtk_widget_get_visible(GTK_WIDGET(dpd->dd->window)))
+	if (dpd->dd->window != NULL && gtk_widget_get_visible(GTK_WIDGET(dpd->dd->window)))
 	{
 		/* we must query geometry settings here because position and maximized state
 		 * doesn't work when the window is hidden */
@@ -175,9 +181,12 @@ static void dict_plugin_free_data(XfcePanelPlugin *plugin, DictPanelData *dpd)
 	/* Destroy the setting dialog, if this open */
 	GtkWidget *dialog = g_object_get_data(G_OBJECT(dpd->plugin), "dialog");
 
+	if (dpd->prebuild_source != 0)
+		g_source_remove(dpd->prebuild_source);
+
 	/* if the main window is visible, query geometry as usual, if it is hidden the geometry
 	 * was queried when it was hidden */
-	if (gtk_widget_get_visible(GTK_WIDGET(dpd->dd->window)))
+	if (dpd->dd->window != NULL && gtk_widget_get_visible(GTK_WIDGET(dpd->dd->window)))
 	{
 		dict_gui_query_geometry(dpd->dd);
 	}
@@ -248,8 +257,7 @@ static void entry_activate_cb(GtkEntry *entry, DictPanelData *dpd)
 {
 	const gchar *entered_text = gtk_entry_get_text(GTK_ENTRY(dpd->dd->panel_entry));
 
-	gtk_entry_set_text(GTK_ENTRY(dpd->dd->main_entry), entered_text);
-
+	/* this also creates the main window if necessary and sets the text of its entry */
 	dict_search_word(dpd->dd, entered_text);
 }
 
@@ -268,7 +276,8 @@ static void entry_icon_release_cb(GtkEntry *entry, GtkEntryIconPosition icon_pos
 	else if (icon_pos == GTK_ENTRY_ICON_SECONDARY)
 	{
 		dict_gui_clear_text_buffer(dpd->dd);
-		gtk_entry_set_text(GTK_ENTRY(dpd->dd->main_entry), "");
+		if (dpd->dd->main_entry != NULL)
+			gtk_entry_set_text(GTK_ENTRY(dpd->dd->main_entry), "");
 		dict_gui_set_panel_entry_text(dpd->dd, "");
 		dict_gui_status_add(dpd->dd, _("Ready"));
 	}
@@ -300,6 +309,15 @@ static gboolean entry_buttonpress_cb(GtkWidget *entry, GdkEventButton *event, Di
 static void entry_changed_cb(GtkEditable *editable, DictPanelData *dpd)
 {
 	entry_is_dirty = TRUE;
+	dict_dictd_warm_up(dpd->dd);
+}
+
+
+static gboolean entry_focus_in_cb(GtkWidget *entry, GdkEventFocus *event, DictPanelData *dpd)
+{
+	dict_dictd_warm_up(dpd->dd);
+
+	return FALSE;
 }
 
 
@@ -308,6 +326,7 @@ static void dict_plugin_drag_data_received(GtkWidget *widget, GdkDragContext *dr
 {
 	if ((data != NULL) && (gtk_selection_data_get_length(data) >= 0) && (gtk_selection_data_get_format(data) == 8))
 	{
+		dict_gui_ensure_main_window(dpd->dd);
 		if (widget == dpd->panel_button || widget == dpd->dd->panel_entry)
 		{
 			gtk_entry_set_text(GTK_ENTRY(dpd->dd->main_entry), (const gchar*) gtk_selection_data_get_data(data));
@@ -318,6 +337,29 @@ static void dict_plugin_drag_data_received(GtkWidget *widget, GdkDragContext *dr
 }
 
 
+/* Connects the plugin's handlers to the main window once it was created */
+static void dict_plugin_window_created(DictData *dd, gpointer data)
+{
+	DictPanelData *dpd = data;
+
+	g_signal_connect(dd->window, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
+	g_signal_connect(dd->close_button, "clicked", G_CALLBACK(dict_plugin_close_button_clicked), dpd);
+
+	/* file menu */
+	g_signal_connect(dd->close_menu_item, "activate", G_CALLBACK(dict_plugin_close_button_clicked), dpd);
+	g_signal_connect(dd->pref_menu_item, "activate", G_CALLBACK(dict_plugin_properties_dialog), dpd);
+}
+
+
+static gboolean dict_plugin_prebuild_window(DictPanelData *dpd)
+{
+	dpd->prebuild_source = 0;
+	dict_gui_ensure_main_window(dpd->dd);
+
+	return FALSE;
+}
+
+
 static void dict_plugin_construct(XfcePanelPlugin *plugin)
 {
 	GtkCssProvider *css_provider;
@@ -348,10 +390,10 @@ static void dict_plugin_construct(XfcePanelPlugin *plugin)
 
 	g_signal_connect(dpd->panel_button, "clicked", G_CALLBACK(dict_plugin_panel_button_clicked), dpd);
 
-	dict_gui_create_main_window(dpd->dd);
+	/* the main window is created when it is needed first, most sessions never open it */
+	dpd->dd->window_created = dict_plugin_window_created;
+	dpd->dd->window_created_data = dpd;
 
-	g_signal_connect(dpd->dd->window, "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL);
-	g_signal_connect(dpd->dd->close_button, "clicked", G_CALLBACK(dict_plugin_close_button_clicked), dpd);
 	g_signal_connect(plugin, "free-data", G_CALLBACK(dict_plugin_free_data), dpd);
 	g_signal_connect(plugin, "size-changed", G_CALLBACK(dict_plugin_panel_set_size), dpd);
 	g_signal_connect(plugin, "mode-changed", G_CALLBACK(dict_plugin_panel_change_mode), dpd);
@@ -363,10 +405,6 @@ static void dict_plugin_construct(XfcePanelPlugin *plugin)
 	xfce_panel_plugin_menu_show_configure(plugin);
 	xfce_panel_plugin_menu_show_about(plugin);
 
-	/* file menu */
-	g_signal_connect(dpd->dd->close_menu_item, "activate", G_CALLBACK(dict_plugin_close_button_clicked), dpd);
-	g_signal_connect(dpd->dd->pref_menu_item, "activate", G_CALLBACK(dict_plugin_properties_dialog), dpd);
-
 	/* panel entry */
 	dpd->dd->panel_entry = gtk_search_entry_new();
 	gtk_widget_set_valign(dpd->dd->panel_entry, GTK_ALIGN_CENTER);
@@ -376,6 +414,7 @@ static void dict_plugin_construct(XfcePanelPlugin *plugin)
 	g_signal_connect(dpd->dd->panel_entry, "activate", G_CALLBACK(entry_activate_cb), dpd);
 	g_signal_connect(dpd->dd->panel_entry, "button-press-event", G_CALLBACK(entry_buttonpress_cb), dpd);
 	g_signal_connect(dpd->dd->panel_entry, "changed", G_CALLBACK(entry_changed_cb), dpd);
+	g_signal_connect(dpd->dd->panel_entry, "focus-in-event", G_CALLBACK(entry_focus_in_cb), dpd);
 
 	dpd->box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 3);
 	gtk_widget_show(dpd->box);
@@ -397,7 +436,12 @@ static void dict_plugin_construct(XfcePanelPlugin *plugin)
 	g_signal_connect(dpd->dd->panel_entry, "drag-data-received", G_CALLBACK(dict_plugin_drag_data_received), dpd);
 
 	dict_acquire_dbus_name(dpd->dd);
+	dict_scan_popup_init(dpd->dd);
 
-	dict_gui_status_add(dpd->dd, _("Ready"));
+	/* prepare the window when the login is over, so that the first click is as fast as
+	 * before without slowing down the start of the panel */
+	if (dpd->dd->prebuild_window)
+		dpd->prebuild_source = g_timeout_add_seconds_full(G_PRIORITY_LOW, DICT_PREBUILD_DELAY,
+			(GSourceFunc) dict_plugin_prebuild_window, dpd, NULL);
 }
 XFCE_PANEL_PLUGIN_REGISTER(dict_plugin_construct);
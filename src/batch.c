@@ -0,0 +1,354 @@
+/*  Copyright 2006-2012 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* Non-interactive lookups of word lists. The words are read line by line, looked up by
+ * a few worker threads and the results are written to stdout in input order as soon as
+ * they are available. */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "libdict.h"
+#include "batch.h"
+
+
+/* number of lookups running at the same time, most servers don't like more connections
+ * per client */
+#define DICT_BATCH_JOBS			4
+/* number of words read ahead of the output */
+#define DICT_BATCH_MAX_PENDING	256
+
+
+typedef struct
+{
+	guint index;
+	gchar *word;
+	gchar *output;	/* the formatted result */
+	gboolean failed;
+} BatchItem;
+
+typedef struct
+{
+	DictData *dd;
+	gboolean spell;
+	gboolean json;
+	DictSpellSession *spell_session;
+	GAsyncQueue *done;
+
+	GHashTable *pending;	/* finished items waiting for their predecessors */
+	guint next_output;
+	gboolean failed;
+} BatchData;
+
+
+static void json_append_string(GString *str, const gchar *value)
+{
+	const gchar *p;
+
+	g_string_append_c(str, '"');
+	for (p = value; *p != '\0'; p++)
+	{
+		switch (*p)
+		{
+			case '"':
+				g_string_append(str, "\\\"");
+				break;
+			case '\\':
+				g_string_append(str, "\\\\");
+				break;
+			case '\n':
+				g_string_append(str, "\\n");
+				break;
+			case '\r':
+				g_string_append(str, "\\r");
+				break;
+			case '\t':
+				g_string_append(str, "\\t");
+				break;
+			default:
+				if ((guchar) *p < 0x20)
+					g_string_append_printf(str, "\\u%04x", (guint) *p);
+				else
+					g_string_append_c(str, *p);
+		}
+	}
+	g_string_append_c(str, '"');
+}
+
+
+static void batch_define(BatchData *batch, BatchItem *item)
+{
+	GPtrArray *definitions;
+	GString *str = g_string_sized_new(1024);
+	DictDefinition *def;
+	const gchar *words[] = { item->word, NULL };
+	gint status;
+	guint i;
+
+	definitions = g_ptr_array_new_with_free_func((GDestroyNotify) dict_definition_free);
+	status = dict_query_define(batch->dd->server, batch->dd->port, batch->dd->dictionary,
+		words, definitions);
+	item->failed = (status != NO_ERROR);
+
+	if (batch->json)
+	{
+		g_string_append(str, "{\"word\": ");
+		json_append_string(str, item->word);
+		if (item->failed)
+		{
+			g_string_append(str, ", \"error\": ");
+			json_append_string(str, dict_query_status_message(status));
+		}
+		g_string_append(str, ", \"definitions\": [");
+		for (i = 0; i < definitions->len; i++)
+		{
+			def = g_ptr_array_index(definitions, i);
+			g_string_append(str, (i > 0) ? ", {\"database\": " : "{\"database\": ");
+			json_append_string(str, def->database);
+			g_string_append(str, ", \"definition\": ");
+			json_append_string(str, def->definition);
+			g_string_append_c(str, '}');
+		}
+		g_string_append(str, "]}\n");
+	}
+	else
+	{
+		/* word (database), the definition and an empty line */
+		if (item->failed)
+			g_string_append_printf(str, "%s: error: %s\n\n", item->word,
+				dict_query_status_message(status));
+		else if (definitions->len == 0)
+			g_string_append_printf(str, "%s: -\n\n", item->word);
+
+		for (i = 0; i < definitions->len; i++)
+		{
+			def = g_ptr_array_index(definitions, i);
+			g_string_append_printf(str, "%s (%s)\n%s\n", item->word, def->database,
+				def->definition);
+		}
+	}
+	item->output = g_string_free(str, FALSE);
+	g_ptr_array_free(definitions, TRUE);
+}
+
+
+static void batch_spell(BatchData *batch, BatchItem *item)
+{
+	DictSpellResult *result;
+	GString *str = g_string_sized_new(256);
+	GError *error = NULL;
+	guint i;
+
+	result = dict_spell_session_check(batch->spell_session, item->word, &error);
+	item->failed = (result == NULL);
+
+	if (batch->json)
+	{
+		g_string_append(str, "{\"word\": ");
+		json_append_string(str, item->word);
+		if (result == NULL)
+		{
+			g_string_append(str, ", \"error\": ");
+			json_append_string(str, error->message);
+		}
+		else
+		{
+			gboolean correct = (result->suggestions[0] != NULL &&
+				strcmp(result->suggestions[0], item->word) == 0);
+
+			g_string_append_printf(str, ", \"correct\": %s, \"suggestions\": [",
+				correct ? "true" : "false");
+			for (i = 0; ! correct && result->suggestions[i] != NULL; i++)
+			{
+				if (i > 0)
+					g_string_append(str, ", ");
+				json_append_string(str, result->suggestions[i]);
+			}
+			g_string_append_c(str, ']');
+		}
+		g_string_append(str, "}\n");
+	}
+	else
+	{
+		/* like ispell: '*' for correct words, '&' with suggestions and '#' without */
+		if (result == NULL)
+			g_string_append_printf(str, "! %s: %s\n", item->word, error->message);
+		else if (result->suggestions[0] == NULL)
+			g_string_append_printf(str, "# %s\n", item->word);
+		else if (strcmp(result->suggestions[0], item->word) == 0)
+			g_string_append_printf(str, "* %s\n", item->word);
+		else
+		{
+			gchar *suggestions = g_strjoinv(", ", result->suggestions);
+
+			g_string_append_printf(str, "& %s: %s\n", item->word, suggestions);
+			g_free(suggestions);
+		}
+	}
+	item->output = g_string_free(str, FALSE);
+
+	if (result != NULL)
+		dict_spell_result_free(result);
+	if (error != NULL)
+		g_error_free(error);
+}
+
+
+/* runs in the worker threads */
+static void batch_lookup(gpointer data, gpointer user_data)
+{
+	BatchItem *item = data;
+	BatchData *batch = user_data;
+
+	if (batch->spell)
+		batch_spell(batch, item);
+	else
+		batch_define(batch, item);
+
+	g_async_queue_push(batch->done, item);
+}
+
+
+/* Writes the item and all following ones which are already done */
+static void batch_write(BatchData *batch, BatchItem *item)
+{
+	g_hash_table_insert(batch->pending, GUINT_TO_POINTER(item->index), item);
+
+	while ((item = g_hash_table_lookup(batch->pending,
+				GUINT_TO_POINTER(batch->next_output))) != NULL)
+	{
+		g_hash_table_remove(batch->pending, GUINT_TO_POINTER(batch->next_output));
+		fputs(item->output, stdout);
+		if (item->failed)
+			batch->failed = TRUE;
+
+		g_free(item->word);
+		g_free(item->output);
+		g_free(item);
+		batch->next_output++;
+	}
+	fflush(stdout);
+}
+
+
+/* Looks up all words read from the file or from stdin if filename is NULL or "-".
+ * Returns the exit status. */
+gint dict_batch_run(DictData *dd, const gchar *filename, gboolean spell, gboolean json)
+{
+	BatchData batch = { 0 };
+	BatchItem *item;
+	GIOChannel *input;
+	GThreadPool *pool;
+	GError *error = NULL;
+	gchar *line;
+	guint n_words = 0, n_running = 0;
+
+	if (filename == NULL || strcmp(filename, "-") == 0)
+		input = g_io_channel_unix_new(STDIN_FILENO);
+	else if ((input = g_io_channel_new_file(filename, "r", &error)) == NULL)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+
+	batch.dd = dd;
+	batch.spell = spell;
+	batch.json = json;
+	if (spell)
+	{
+		if (! NZV(dd->spell_bin))
+		{
+			g_printerr("%s\n", _("Please set the spell check command in the preferences dialog."));
+			g_io_channel_unref(input);
+			return EXIT_FAILURE;
+		}
+		/* one spell checker process for all words */
+		batch.spell_session = dict_spell_session_new(dd->spell_bin, dd->spell_dictionary, &error);
+		if (batch.spell_session == NULL)
+		{
+			g_printerr(_("Process failed (%s)"), error->message);
+			g_printerr("\n");
+			g_error_free(error);
+			g_io_channel_unref(input);
+			return EXIT_FAILURE;
+		}
+	}
+	batch.done = g_async_queue_new();
+	batch.pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+	pool = g_thread_pool_new(batch_lookup, &batch, DICT_BATCH_JOBS, FALSE, NULL);
+
+	while (g_io_channel_read_line(input, &line, NULL, NULL, &error) == G_IO_STATUS_NORMAL)
+	{
+		g_strstrip(line);
+		if (*line == '\0')
+		{
+			g_free(line);
+			continue;
+		}
+
+		item = g_new0(BatchItem, 1);
+		item->index = n_words++;
+		item->word = line;
+		g_thread_pool_push(pool, item, NULL);
+		n_running++;
+
+		/* don't read too far ahead but write what's done */
+		if (n_running >= DICT_BATCH_MAX_PENDING)
+		{
+			batch_write(&batch, g_async_queue_pop(batch.done));
+			n_running--;
+		}
+		while ((item = g_async_queue_try_pop(batch.done)) != NULL)
+		{
+			batch_write(&batch, item);
+			n_running--;
+		}
+	}
+	if (error != NULL)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		batch.failed = TRUE;
+	}
+
+	while (n_running > 0)
+	{
+		batch_write(&batch, g_async_queue_pop(batch.done));
+		n_running--;
+	}
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+	g_hash_table_destroy(batch.pending);
+	g_async_queue_unref(batch.done);
+	dict_spell_session_free(batch.spell_session);
+	dict_connection_pool_clear();
+	g_io_channel_unref(input);
+
+	return batch.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+#
+# Runs the dictd client benchmark for "make check" and fails if a lookup against the
+# local fake server fails or needs more socket syscalls than it used to.
+#
+# A lookup from the connection pool needs one send() and one recv(), a new connection
+# per lookup needs 11 syscalls. The count doesn't depend on the machine or on GLib, the
+# latency and the allocations are only checked by "make bench".
+
+exec ./dict-bench --lookups 200 --parse-rounds 200 --max-syscalls 4
@@ -0,0 +1,522 @@
+/*  Copyright 2006-2012 Enrico Tröger <enrico(at)xfce(dot)org>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Library General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+/* Benchmark for the dictd client code. It starts a fake dictd server in a thread which
+ * replays a canned (or recorded) DEFINE reply with configurable latency and bandwidth,
+ * runs the real query code against it and reports the latency, the socket syscalls and
+ * the allocations per lookup. No network access is needed.
+ * It only needs the GUI-free part of the library. "make check" runs it with a syscall
+ * limit (see check-bench.sh). "make bench" runs the dict-bench-allocs build, which also
+ * counts allocations, with latency and allocation limits. */
+
+
+/* for RTLD_NEXT */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <gio/gio.h>
+
+#include "dictparser.h"
+#include "query.h"
+#include "cache.h"
+
+
+/* used if no transcript is given, the same as dict.org sends for "cat" in WordNet */
+#define BENCH_DEFAULT_REPLY \
+	"150 1 definitions retrieved\r\n" \
+	"151 \"cat\" wn \"WordNet (r) 3.0 (2006)\"\r\n" \
+	"cat\r\n" \
+	"    n 1: feline mammal usually having thick soft fur and no ability\r\n" \
+	"         to roar: domestic cats; wildcats [syn: {true cat}, {cat}]\r\n" \
+	"    2: an informal term for a youth or man; \"a nice guy\"; \"the guy's\r\n" \
+	"       only doing it for some doll\" [syn: {guy}, {cat}, {hombre},\r\n" \
+	"       {bozo}, {sod}]\r\n" \
+	"    3: a spiteful woman gossip; \"what a cat she is!\"\r\n" \
+	"    v 1: beat with a cat-o'-nine-tails\r\n" \
+	"    2: eject the contents of the stomach through the mouth; \"After\r\n" \
+	"       drinking too much, the students vomited\"; \"He purged\r\n" \
+	"       continuously\" [syn: {vomit}, {vomit up}, {purge}, {cast},\r\n" \
+	"       {sick}, {cat}, {be sick}, {disgorge}, {regorge}, {retch},\r\n" \
+	"       {puke}, {barf}, {spew}, {spue}, {chuck}, {upchuck}, {honk},\r\n" \
+	"       {regurgitate}, {throw up}]\r\n" \
+	".\r\n" \
+	"250 ok [d/m/c = 1/0/20; 0.000r 0.000u 0.000s]\r\n"
+
+
+typedef struct
+{
+	gchar *reply;		/* the answer to DEFINE */
+	gsize reply_len;
+	gint latency;		/* delay before each reply in microseconds */
+	gint bandwidth;		/* bytes per second or 0 for unlimited */
+} BenchServer;
+
+
+static gint n_lookups = 1000;
+static gint latency_ms = 0;
+static gint bandwidth_kb = 0;
+static gchar *transcript = NULL;
+static gboolean reconnect = FALSE;
+static gint parse_rounds = 10000;
+static gdouble max_p99_ms = 0;
+static gdouble max_syscalls = 0;
+static gdouble max_allocs = 0;
+
+static GOptionEntry bench_options[] =
+{
+	{ "lookups", 'n', 0, G_OPTION_ARG_INT, &n_lookups, "Number of lookups (default: 1000)", "N" },
+	{ "latency", 'l', 0, G_OPTION_ARG_INT, &latency_ms, "Server latency per reply in milliseconds", "MS" },
+	{ "bandwidth", 'b', 0, G_OPTION_ARG_INT, &bandwidth_kb, "Server bandwidth in KiB/s (default: unlimited)", "KIB" },
+	{ "transcript", 't', 0, G_OPTION_ARG_FILENAME, &transcript, "File with a recorded reply to DEFINE, starting with the 150 line", "FILE" },
+	{ "reconnect", 'r', 0, G_OPTION_ARG_NONE, &reconnect, "Open a new connection for every lookup", NULL },
+	{ "parse-rounds", 'p', 0, G_OPTION_ARG_INT, &parse_rounds, "Number of rounds for the parser benchmark (default: 10000)", "N" },
+	{ "max-p99", 0, 0, G_OPTION_ARG_DOUBLE, &max_p99_ms, "Fail if the p99 latency exceeds this many milliseconds", "MS" },
+	{ "max-syscalls", 0, 0, G_OPTION_ARG_DOUBLE, &max_syscalls, "Fail if a lookup needs more socket syscalls on average", "N" },
+	{ "max-allocs", 0, 0, G_OPTION_ARG_DOUBLE, &max_allocs, "Fail if a lookup needs more allocations on average", "N" },
+	{ NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+
+/* Counting of socket syscalls and allocations. The functions are overridden in this
+ * program and only calls made by the thread running the lookups are counted, the fake
+ * server is not measured. The real functions are looked up on first use as they may be
+ * called before main(). */
+static __thread gboolean counting = FALSE;
+static guint64 n_syscalls = 0;
+static guint64 n_allocs = 0;
+
+static ssize_t (*real_recv) (int, void *, size_t, int);
+static ssize_t (*real_send) (int, const void *, size_t, int);
+static int (*real_socket) (int, int, int);
+static int (*real_connect) (int, const struct sockaddr *, socklen_t);
+static int (*real_setsockopt) (int, int, int, const void *, socklen_t);
+static int (*real_close) (int);
+
+
+ssize_t recv(int fd, void *buf, size_t len, int flags)
+{
+	if (real_recv == NULL)
+		real_recv = dlsym(RTLD_NEXT, "recv");
+	if (counting)
+		n_syscalls++;
+	return real_recv(fd, buf, len, flags);
+}
+
+
+ssize_t send(int fd, const void *buf, size_t len, int flags)
+{
+	if (real_send == NULL)
+		real_send = dlsym(RTLD_NEXT, "send");
+	if (counting)
+		n_syscalls++;
+	return real_send(fd, buf, len, flags);
+}
+
+
+int socket(int domain, int type, int protocol)
+{
+	if (real_socket == NULL)
+		real_socket = dlsym(RTLD_NEXT, "socket");
+	if (counting)
+		n_syscalls++;
+	return real_socket(domain, type, protocol);
+}
+
+
+int connect(int fd, const struct sockaddr *addr, socklen_t len)
+{
+	if (real_connect == NULL)
+		real_connect = dlsym(RTLD_NEXT, "connect");
+	if (counting)
+		n_syscalls++;
+	return real_connect(fd, addr, len);
+}
+
+
+int setsockopt(int fd, int level, int name, const void *value, socklen_t len)
+{
+	if (real_setsockopt == NULL)
+		real_setsockopt = dlsym(RTLD_NEXT, "setsockopt");
+	if (counting)
+		n_syscalls++;
+	return real_setsockopt(fd, level, name, value, len);
+}
+
+
+int close(int fd)
+{
+	if (real_close == NULL)
+		real_close = dlsym(RTLD_NEXT, "close");
+	if (counting)
+		n_syscalls++;
+	return real_close(fd);
+}
+
+
+/* Allocations are only counted in the dict-bench-allocs build. Replacing malloc() doesn't
+ * work together with the allocators of AddressSanitizer and valgrind, so the plain build
+ * used by "make check" leaves it alone. */
+#if defined(__SANITIZE_ADDRESS__)
+# define BENCH_ASAN 1
+#elif defined(__has_feature)
+# if __has_feature(address_sanitizer)
+#  define BENCH_ASAN 1
+# endif
+#endif
+
+#if defined(DICT_BENCH_COUNT_ALLOCS) && defined(__GLIBC__) && ! defined(BENCH_ASAN)
+/* dlsym() allocates itself, so the allocator is wrapped using glibc's internal names */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	if (counting)
+		n_allocs++;
+	return __libc_malloc(size);
+}
+
+
+void *calloc(size_t n, size_t size)
+{
+	if (counting)
+		n_allocs++;
+	return __libc_calloc(n, size);
+}
+
+
+void *realloc(void *ptr, size_t size)
+{
+	if (counting)
+		n_allocs++;
+	return __libc_realloc(ptr, size);
+}
+# define BENCH_COUNT_ALLOCS 1
+#else
+# define BENCH_COUNT_ALLOCS 0
+#endif
+
+
+/* Writes the data, limited to the configured bandwidth */
+static gboolean server_write(BenchServer *server, GSocket *client, const gchar *data, gsize len)
+{
+	gsize chunk, sent = 0;
+	gssize n;
+
+	while (sent < len)
+	{
+		/* with limited bandwidth send 100 chunks per second */
+		chunk = (server->bandwidth > 0) ? MAX(server->bandwidth / 100, 1) : len;
+		n = g_socket_send(client, data + sent, MIN(chunk, len - sent), NULL, NULL);
+		if (n <= 0)
+			return FALSE;
+		sent += n;
+		if (server->bandwidth > 0)
+			g_usleep(G_USEC_PER_SEC / 100);
+	}
+	return TRUE;
+}
+
+
+static gpointer server_client_thread(gpointer data)
+{
+	GSocket *client = data;
+	BenchServer *server = g_object_get_data(G_OBJECT(client), "server");
+	gchar buf[1024];
+	GString *line = g_string_sized_new(128);
+	gchar *eol;
+	gssize n;
+	const gchar *answer;
+	gsize len;
+
+	server_write(server, client, "220 dict-bench <auth.mime> <1.1@bench>\r\n", 40);
+
+	/* the accepted socket is non-blocking, only the GSocket functions wait for data */
+	while ((n = g_socket_receive(client, buf, sizeof(buf), NULL, NULL)) > 0)
+	{
+		g_string_append_len(line, buf, n);
+		while ((eol = strchr(line->str, '\n')) != NULL)
+		{
+			*eol = '\0';
+			if (g_ascii_strncasecmp(line->str, "DEFINE ", 7) == 0)
+			{
+				answer = server->reply;
+				len = server->reply_len;
+			}
+			else if (g_ascii_strncasecmp(line->str, "QUIT", 4) == 0)
+			{
+				answer = "221 bye\r\n";
+				len = strlen(answer);
+			}
+			else
+			{
+				answer = "500 unknown command\r\n";
+				len = strlen(answer);
+			}
+			g_string_erase(line, 0, eol - line->str + 1);
+
+			if (server->latency > 0)
+				g_usleep(server->latency);
+			if (! server_write(server, client, answer, len) || answer[0] == '2')
+				goto done;
+		}
+	}
+done:
+	g_string_free(line, TRUE);
+	g_object_unref(client);
+	return NULL;
+}
+
+
+static gpointer server_thread(gpointer data)
+{
+	GSocket *listener = data;
+	GSocket *client;
+
+	while ((client = g_socket_accept(listener, NULL, NULL)) != NULL)
+	{
+		g_object_set_data(G_OBJECT(client), "server", g_object_get_data(G_OBJECT(listener), "server"));
+		g_thread_unref(g_thread_new(NULL, server_client_thread, client));
+	}
+	return NULL;
+}
+
+
+/* Starts the fake server on a free port of the loopback interface and returns the port */
+static gint server_start(BenchServer *server)
+{
+	GSocket *listener;
+	GInetAddress *loopback;
+	GSocketAddress *address;
+	GError *error = NULL;
+	gint port;
+
+	listener = g_socket_new(G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, &error);
+	loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+	address = g_inet_socket_address_new(loopback, 0);
+	if (listener == NULL || ! g_socket_bind(listener, address, TRUE, &error) ||
+		! g_socket_listen(listener, &error))
+	{
+		g_printerr("Could not start the server: %s\n", error->message);
+		exit(EXIT_FAILURE);
+	}
+	g_object_unref(address);
+	g_object_unref(loopback);
+
+	address = g_socket_get_local_address(listener, NULL);
+	port = g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(address));
+	g_object_unref(address);
+
+	g_object_set_data(G_OBJECT(listener), "server", server);
+	g_thread_unref(g_thread_new(NULL, server_thread, listener));
+
+	return port;
+}
+
+
+static gint compare_times(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *) a;
+	gint64 y = *(const gint64 *) b;
+
+	return (x > y) - (x < y);
+}
+
+
+static gdouble percentile(gint64 *times, gint n, gint p)
+{
+	return times[MIN(n - 1, (n * p) / 100)] / 1000.0;
+}
+
+
+/* Parses the reply and the definition markup without any networking, the temporary
+ * memory of the markup is taken from an arena per reply like when rendering */
+static void bench_parser(BenchServer *server)
+{
+	DictReply *reply;
+	DictArena *arena;
+	GString *text = g_string_sized_new(1024);
+	GArray *spans = g_array_new(FALSE, FALSE, sizeof(DictSpan));
+	gint64 start, elapsed;
+	guint64 allocs;
+	guint i, j;
+
+	n_allocs = 0;
+	start = g_get_monotonic_time();
+	counting = TRUE;
+	for (i = 0; i < (guint) parse_rounds; i++)
+	{
+		reply = dict_parser_parse(server->reply, server->reply_len);
+		arena = dict_arena_new(0);
+		for (j = 0; j < reply->definitions->len; j++)
+		{
+			DictDefinition *def = g_ptr_array_index(reply->definitions, j);
+
+			g_string_truncate(text, 0);
+			g_array_set_size(spans, 0);
+			dict_parser_markup(def->definition, text, spans, arena);
+		}
+		dict_arena_free(arena);
+		dict_reply_free(reply);
+	}
+	counting = FALSE;
+	elapsed = MAX(g_get_monotonic_time() - start, 1);
+	allocs = n_allocs;
+
+	g_print("parser:  %d rounds, %.1f MiB/s, %.2f us per reply",
+		parse_rounds, (gdouble) server->reply_len * parse_rounds / elapsed * 1000000 / (1024 * 1024),
+		(gdouble) elapsed / parse_rounds);
+	if (BENCH_COUNT_ALLOCS)
+		g_print(", %.1f allocations per reply", (gdouble) allocs / parse_rounds);
+	g_print("\n");
+
+	g_string_free(text, TRUE);
+	g_array_free(spans, TRUE);
+}
+
+
+/* Looks up the word n_lookups times through the real query code. Returns FALSE if a
+ * limit was exceeded or a lookup failed. */
+static gboolean bench_lookups(gint port)
+{
+	const gchar *words[] = { "cat", NULL };
+	GPtrArray *definitions;
+	gint64 *times = g_new(gint64, n_lookups);
+	gint64 start;
+	gint i, status, failed = 0;
+	gdouble syscalls, allocs, p99;
+	gboolean result = TRUE;
+
+	definitions = g_ptr_array_new_with_free_func((GDestroyNotify) dict_definition_free);
+	n_syscalls = 0;
+	n_allocs = 0;
+	for (i = 0; i < n_lookups; i++)
+	{
+		/* every lookup goes to the server, otherwise all but the first are answered from
+		 * the cache */
+		dict_cache_clear();
+		start = g_get_monotonic_time();
+		counting = TRUE;
+		status = dict_query_define("127.0.0.1", port, "wn", words, definitions);
+		if (reconnect)
+			dict_connection_pool_clear();
+		counting = FALSE;
+		times[i] = g_get_monotonic_time() - start;
+
+		if (status != NO_ERROR || definitions->len == 0)
+			failed++;
+		g_ptr_array_set_size(definitions, 0);
+	}
+	dict_connection_pool_clear();
+	g_ptr_array_free(definitions, TRUE);
+
+	qsort(times, n_lookups, sizeof(gint64), compare_times);
+	syscalls = (gdouble) n_syscalls / n_lookups;
+	allocs = (gdouble) n_allocs / n_lookups;
+	p99 = percentile(times, n_lookups, 99);
+
+	g_print("lookups: %d (%d failed), p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		n_lookups, failed, percentile(times, n_lookups, 50), p99, times[n_lookups - 1] / 1000.0);
+	g_print("         %.1f socket syscalls per lookup", syscalls);
+	if (BENCH_COUNT_ALLOCS)
+		g_print(", %.1f allocations per lookup", allocs);
+	g_print("\n");
+
+	if (failed > 0)
+		result = FALSE;
+	if (max_p99_ms > 0 && p99 > max_p99_ms)
+	{
+		g_printerr("p99 latency %.3f ms exceeds %.3f ms\n", p99, max_p99_ms);
+		result = FALSE;
+	}
+	if (max_syscalls > 0 && syscalls > max_syscalls)
+	{
+		g_printerr("%.1f socket syscalls per lookup exceed %.1f\n", syscalls, max_syscalls);
+		result = FALSE;
+	}
+	if (! BENCH_COUNT_ALLOCS && max_allocs > 0)
+		g_print("Allocations are not counted in this build, --max-allocs is ignored.\n");
+	else if (max_allocs > 0 && allocs > max_allocs)
+	{
+		g_printerr("%.1f allocations per lookup exceed %.1f\n", allocs, max_allocs);
+		result = FALSE;
+	}
+	g_free(times);
+
+	return result;
+}
+
+
+gint main(gint argc, gchar *argv[])
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	BenchServer server = { 0 };
+	gint port;
+
+	context = g_option_context_new(NULL);
+	g_option_context_set_summary(context,
+		"Benchmarks the dictd client code against a local fake server.");
+	g_option_context_add_main_entries(context, bench_options, NULL);
+	if (! g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	if (n_lookups < 1 || parse_rounds < 1)
+	{
+		g_printerr("The number of lookups and parser rounds must be positive.\n");
+		return EXIT_FAILURE;
+	}
+
+	if (transcript != NULL)
+	{
+		if (! g_file_get_contents(transcript, &server.reply, &server.reply_len, &error))
+		{
+			g_printerr("%s\n", error->message);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		server.reply = g_strdup(BENCH_DEFAULT_REPLY);
+		server.reply_len = strlen(server.reply);
+	}
+	server.latency = latency_ms * 1000;
+	server.bandwidth = bandwidth_kb * 1024;
+
+	port = server_start(&server);
+
+	bench_parser(&server);
+	return bench_lookups(port) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
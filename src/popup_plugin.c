@@ -24,23 +24,87 @@
 #include <string.h>
 
 #include "libdict.h"
+#include "popup_plugin.h"
 
 
-gboolean dict_find_panel_plugin(gchar flags, const gchar *text);
+/* Asks the bus daemon for the unique name of the owner of the name, NULL if there is none.
+ * This is a single round trip and never starts a service, so it returns instantly when no
+ * plugin is running. */
+static gchar *get_name_owner(GDBusConnection *connection, const gchar *name)
+{
+	GVariant *reply;
+	GError   *error = NULL;
+	gchar    *owner = NULL;
+
+	reply = g_dbus_connection_call_sync(connection,
+		"org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+		"GetNameOwner", g_variant_new("(s)", name), G_VARIANT_TYPE("(s)"),
+		G_DBUS_CALL_FLAGS_NO_AUTO_START, -1, NULL, &error);
+
+	if (reply == NULL)
+	{
+		if (! g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NAME_HAS_NO_OWNER))
+			g_warning("error checking for the owner of %s, reason was: %s", name, error->message);
+		g_clear_error(&error);
+		return NULL;
+	}
+	g_variant_get(reply, "(s)", &owner);
+	g_variant_unref(reply);
+
+	return owner;
+}
 
 
+static gboolean name_has_owner(GDBusConnection *connection, const gchar *name)
+{
+	gchar *owner = get_name_owner(connection, name);
+
+	g_free(owner);
+	return (owner != NULL);
+}
+
+
+/* This is called before GTK is initialised, so it must not use any GTK functions. */
 gboolean dict_find_panel_plugin(gchar flags, const gchar *text)
 {
-	gboolean  ret = FALSE;
-	GError   *error = NULL;
-	Dict     *proxy;
+	gboolean         ret = FALSE;
+	GError          *error = NULL;
+	GDBusConnection *connection;
+	Dict            *proxy;
+	gchar           *owner, *daemon_owner = NULL;
 
-	proxy = dict_proxy_new_for_bus_sync (G_BUS_TYPE_SESSION,
-																			G_DBUS_PROXY_FLAGS_NONE,
-																			"org.xfce.Dict",
-																			"/org/xfce/Dict",
-																			NULL,
-																			&error);
+	connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, &error);
+	if (connection == NULL)
+	{
+		g_warning("error connecting to the session bus, reason was: %s", error->message);
+		g_clear_error(&error);
+		return FALSE;
+	}
+
+	/* a daemon can't show the results, it owns a second name to be told apart from the
+	 * panel plugin and the stand-alone window */
+	owner = get_name_owner(connection, "org.xfce.Dict");
+	if (owner != NULL)
+		daemon_owner = get_name_owner(connection, DICT_DAEMON_NAME);
+	if (owner == NULL || g_strcmp0(owner, daemon_owner) == 0)
+	{
+		g_free(owner);
+		g_free(daemon_owner);
+		g_object_unref(connection);
+		return FALSE;
+	}
+	g_free(owner);
+	g_free(daemon_owner);
+
+	proxy = dict_proxy_new_sync(connection,
+		G_DBUS_PROXY_FLAGS_DO_NOT_AUTO_START |
+		G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+		G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+		"org.xfce.Dict",
+		"/org/xfce/Dict",
+		NULL,
+		&error);
+	g_object_unref(connection);
 
 	if (!proxy)
 	{
@@ -49,14 +113,39 @@ gboolean dict_find_panel_plugin(gchar flags, const gchar *text)
 		return FALSE;
 	}
 
+	/* the owner should answer right away, don't wait for the default timeout of
+	 * 25 seconds if it hangs */
+	g_dbus_proxy_set_default_timeout(G_DBUS_PROXY(proxy), 3000);
 	ret = dict_call_search_sync (proxy, text, NULL, &error);
+	g_object_unref(proxy);
 
 	if (error)
 	{
-		g_warning ("failed to connecting to org.xfce.Dict, reason was: %s", error->message);
+		/* a daemon which took the name over in the meantime, the search is shown in a
+		 * new window then */
+		if (! g_error_matches(error, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED))
+			g_warning ("failed to connect to org.xfce.Dict, reason was: %s", error->message);
 		g_clear_error(&error);
 		return FALSE;
 	}
 
 	return ret;
 }
+
+
+/* Returns TRUE if a stand-alone instance is running, it takes the whole command line
+ * including the search method while the panel plugin only takes the search text */
+gboolean dict_find_stand_alone_app(void)
+{
+	GDBusConnection *connection;
+	gboolean ret;
+
+	connection = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+	if (connection == NULL)
+		return FALSE;
+
+	ret = name_has_owner(connection, DICT_APP_ID);
+	g_object_unref(connection);
+
+	return ret;
+}
@@ -20,6 +20,11 @@
 #define POPUP_PLUGIN_H 1
 
 
+/* the application ID of the stand-alone instance */
+#define DICT_APP_ID "org.xfce.xfce4-dict"
+
+
 gboolean dict_find_panel_plugin(gchar flags, const gchar *text);
+gboolean dict_find_stand_alone_app(void);
 
 #endif
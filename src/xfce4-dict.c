@@ -21,11 +21,13 @@
 #endif
 
 #include <stdio.h>
+#include <signal.h>
 #include <gtk/gtk.h>
 #include <string.h>
 #include <stdlib.h>
 
 #include <libxfce4util/libxfce4util.h>
+#include <glib-unix.h>
 
 #if HAVE_LOCALE_H
 # include <locale.h>
@@ -33,6 +35,7 @@
 
 #include "libdict.h"
 #include "popup_plugin.h"
+#include "batch.h"
 
 
 static gboolean show_version = FALSE;
@@ -42,16 +45,26 @@ static gboolean focus_panel_entry = FALSE;
 static gboolean mode_dict = FALSE;
 static gboolean mode_web = FALSE;
 static gboolean mode_spell = FALSE;
+static gboolean mode_all = FALSE;
 static gboolean verbose_mode = FALSE;
+static gboolean daemon_mode = FALSE;
+static gboolean batch_mode = FALSE;
+static gboolean json_output = FALSE;
+
+static gint64 start_time;
 
 static GOptionEntry cli_options[] =
 {
 	{ "dict", 'd', 0, G_OPTION_ARG_NONE, &mode_dict, N_("Search the given text using a Dict server(RFC 2229)"), NULL },
 	{ "web", 'w', 0, G_OPTION_ARG_NONE, &mode_web, N_("Search the given text using a web-based search engine"), NULL },
 	{ "spell", 's', 0, G_OPTION_ARG_NONE, &mode_spell, N_("Check the given text with a spell checker"), NULL },
+	{ "all", 'a', 0, G_OPTION_ARG_NONE, &mode_all, N_("Search the given text with all of the above except the web search at once"), NULL },
 	{ "text-field", 't', 0, G_OPTION_ARG_NONE, &focus_panel_entry, N_("Grab the focus on the text field in the panel"), NULL },
 	{ "ignore-plugin", 'i', 0, G_OPTION_ARG_NONE, &ignore_plugin, N_("Start stand-alone application even if the panel plugin is loaded"), NULL },
 	{ "clipboard", 'c', 0, G_OPTION_ARG_NONE, &use_clipboard, N_("Grabs the PRIMARY selection content and uses it as search text"), NULL },
+	{ "daemon", 0, 0, G_OPTION_ARG_NONE, &daemon_mode, N_("Serve lookups over D-Bus without opening a window"), NULL },
+	{ "batch", 'b', 0, G_OPTION_ARG_NONE, &batch_mode, N_("Look up the words read from the given file or from stdin, one per line, and print the results"), NULL },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json_output, N_("Print the results of --batch as JSON, one object per line"), NULL },
 	{ "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose_mode, N_("Be verbose"), NULL },
 	{ "version", 'V', 0, G_OPTION_ARG_NONE, &show_version, N_("Show version information"), NULL },
 	{ NULL, 0, 0, 0, NULL, NULL, NULL }
@@ -60,9 +73,13 @@ static GOptionEntry cli_options[] =
 
 static gboolean main_quit(GtkWidget *widget, GdkEvent *event, DictData *dd)
 {
+	if (verbose_mode)
+		dict_stats_print();
+
 	dict_gui_query_geometry(dd);
 	dict_free_data(dd);
-    gtk_main_quit();
+	/* the application quits when its window is gone, later command lines start over */
+	g_object_set_data(G_OBJECT(g_application_get_default()), "dictdata", NULL);
 
     return FALSE;
 }
@@ -83,6 +100,90 @@ static void pref_dialog_activated(GtkMenuItem *menuitem, DictData *dd)
 }
 
 
+/* report the launch-to-window time once, compare cold and warm starts with --verbose */
+static gboolean window_mapped_cb(GtkWidget *widget, GdkEvent *event, gpointer data)
+{
+	g_message("Window shown after %.1f ms",
+		(g_get_monotonic_time() - start_time) / 1000.0);
+	g_signal_handlers_disconnect_by_func(widget, window_mapped_cb, data);
+
+	return FALSE;
+}
+
+
+static gboolean daemon_quit(gpointer data)
+{
+	g_main_loop_quit(data);
+
+	return FALSE;
+}
+
+
+/* Serves the D-Bus lookups without any window, GTK is never initialised */
+static gint run_daemon(void)
+{
+	DictData *dd;
+	GMainLoop *loop;
+
+	dd = dict_create_dictdata();
+	dd->is_plugin = FALSE;
+	dd->is_daemon = TRUE;
+	dd->verbose_mode = verbose_mode;
+
+	dict_read_rc_file(dd);
+
+	loop = g_main_loop_new(NULL, FALSE);
+	g_unix_signal_add(SIGINT, daemon_quit, loop);
+	g_unix_signal_add(SIGTERM, daemon_quit, loop);
+
+	dict_acquire_dbus_name(dd);
+
+	if (verbose_mode)
+		g_message("Serving lookups after %.1f ms",
+			(g_get_monotonic_time() - start_time) / 1000.0);
+
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+
+	if (verbose_mode)
+		dict_stats_print();
+
+	return EXIT_SUCCESS;
+}
+
+
+static gchar get_flags(void);
+
+
+/* Looks up the words from the file given on the command line or from stdin, GTK is never
+ * initialised */
+static gint run_batch(gint argc, gchar *argv[])
+{
+	DictData *dd;
+	dict_mode_t mode;
+	gint status;
+
+	dd = dict_create_dictdata();
+	dd->is_plugin = FALSE;
+	dd->verbose_mode = verbose_mode;
+
+	dict_read_rc_file(dd);
+
+	mode = dict_set_search_mode_from_flags(dd->mode_in_use, get_flags());
+	if (mode == DICTMODE_WEB && mode_web)
+	{
+		g_printerr("%s\n", _("Web searches are not available in batch mode."));
+		return EXIT_FAILURE;
+	}
+
+	status = dict_batch_run(dd, (argc > 1) ? argv[1] : NULL, mode == DICTMODE_SPELL, json_output);
+	if (verbose_mode)
+		dict_stats_print();
+
+	return status;
+}
+
+
 static gchar get_flags(void)
 {
 	gchar flags = 0;
@@ -95,6 +196,8 @@ static gchar get_flags(void)
 		flags |= DICT_FLAGS_MODE_WEB;
 	if (mode_spell)
 		flags |= DICT_FLAGS_MODE_SPELL;
+	if (mode_all)
+		flags |= DICT_FLAGS_MODE_ALL;
 
 	return flags;
 }
@@ -115,26 +218,126 @@ static gchar *get_search_text(gint count, gchar **values)
 }
 
 
+static void reset_options(void)
+{
+	show_version = ignore_plugin = use_clipboard = focus_panel_entry = FALSE;
+	mode_dict = mode_web = mode_spell = mode_all = FALSE;
+	daemon_mode = batch_mode = json_output = FALSE;
+}
+
+
+static void create_window(GtkApplication *app, DictData *dd)
+{
+	dict_gui_create_main_window(dd);
+	gtk_application_add_window(app, GTK_WINDOW(dd->window));
+
+	g_signal_connect(dd->window, "delete-event", G_CALLBACK(main_quit), dd);
+	g_signal_connect(dd->close_button, "clicked", G_CALLBACK(close_button_clicked), dd);
+	/* file menu */
+	g_signal_connect(dd->close_menu_item, "activate", G_CALLBACK(close_button_clicked), dd);
+	g_signal_connect(dd->pref_menu_item, "activate", G_CALLBACK(pref_dialog_activated), dd);
+}
+
+
+/* Runs in the primary instance for its own command line and for the ones of all later
+ * invocations, these exit as soon as it is handled */
+static gint app_command_line(GApplication *app, GApplicationCommandLine *cmdline, gpointer data)
+{
+	DictData *dd = g_object_get_data(G_OBJECT(app), "dictdata");
+	GOptionContext *context;
+	gchar **argv;
+	gchar *search_text;
+	gchar flags;
+	gboolean first = (dd == NULL);
+
+	argv = g_application_command_line_get_arguments(cmdline, NULL);
+
+	reset_options();
+	context = g_option_context_new(NULL);
+	g_option_context_add_main_entries(context, cli_options, GETTEXT_PACKAGE);
+	/* e.g. the GTK options, these were handled by the invoking process */
+	g_option_context_set_ignore_unknown_options(context, TRUE);
+	g_option_context_set_help_enabled(context, FALSE);
+	g_option_context_parse_strv(context, &argv, NULL);
+	g_option_context_free(context);
+
+	flags = get_flags();
+	if (use_clipboard)
+		search_text = dict_get_clipboard_contents();
+	else
+		search_text = get_search_text(g_strv_length(argv), argv);
+	g_strfreev(argv);
+
+	if (first)
+	{
+		gtk_window_set_default_icon_name("xfce4-dict");
+
+		dd = dict_create_dictdata();
+		dd->is_plugin = FALSE;
+		dd->verbose_mode = verbose_mode;
+		g_object_set_data(G_OBJECT(app), "dictdata", dd);
+
+		dict_read_rc_file(dd);
+
+		/* set search mode from command line flags, if any */
+		dd->mode_in_use = dict_set_search_mode_from_flags(dd->mode_in_use, flags);
+
+		create_window(GTK_APPLICATION(app), dd);
+		dict_scan_popup_init(dd);
+	}
+	else
+		dict_gui_set_search_mode(dd, dict_set_search_mode_from_flags(dd->mode_in_use, flags));
+
+	/* search text from command line options, if any */
+	if (NZV(search_text))
+	{
+		gtk_entry_set_text(GTK_ENTRY(dd->main_entry), search_text);
+		dict_search_word(dd, search_text);
+	}
+	else if (first)
+		dict_gui_status_add(dd, _("Ready"));
+	else
+		dict_gui_show_main_window(dd);
+
+	g_free(search_text);
+
+	if (first)
+	{
+		dict_acquire_dbus_name(dd);
+
+		if (verbose_mode)
+			g_signal_connect(dd->window, "map-event", G_CALLBACK(window_mapped_cb), NULL);
+		gtk_widget_show_all(dd->window);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
 gint main(gint argc, gchar *argv[])
 {
-	DictData *dd;
+	GtkApplication *app;
 	GOptionContext *context;
 	gchar flags;
 	gchar *search_text;
+	gchar **app_argv;
+	gint status;
+
+	start_time = g_get_monotonic_time();
 
 #ifdef ENABLE_NLS
 	xfce_textdomain(GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR, "UTF-8");
 #endif
 
+	/* the unparsed command line is passed on to the primary instance */
+	app_argv = g_strdupv(argv);
+
 	context = g_option_context_new(_("[TEXT]"));
 	g_option_context_add_main_entries(context, cli_options, GETTEXT_PACKAGE);
 	g_option_group_set_translation_domain(g_option_context_get_main_group(context), GETTEXT_PACKAGE);
 	g_option_context_add_group(context, gtk_get_option_group(FALSE));
 	g_option_context_parse(context, &argc, &argv, NULL);
 
-	gtk_init(&argc, &argv);
-    gtk_window_set_default_icon_name("xfce4-dict");
-
 	g_option_context_free(context);
 
 	if (show_version)
@@ -145,63 +348,60 @@ gint main(gint argc, gchar *argv[])
 		g_print(_("Please report bugs to <%s>."), PACKAGE_BUGREPORT);
 		g_print("\n");
 
+		g_strfreev(app_argv);
 		return EXIT_SUCCESS;
 	}
 
-	flags = get_flags();
-
-	if (use_clipboard)
-	{
-		search_text = dict_get_clipboard_contents();
-	}
-	else
-	{
-		/* concatenate remaining command line arguments */
-		search_text = get_search_text(argc, argv);
-	}
-
-	/* try to find an existing panel plugin and pop it up */
-	if (! ignore_plugin && dict_find_panel_plugin(flags, search_text))
-	{
-		g_free(search_text);
-		exit(0);
-	}
-
-	/* no plugin found, start stand-alone app */
-
-	dd = dict_create_dictdata();
-	dd->is_plugin = FALSE;
-	dd->verbose_mode = verbose_mode;
-
-	dict_read_rc_file(dd);
-
-	/* set search mode from command line flags, if any */
-	dd->mode_in_use = dict_set_search_mode_from_flags(dd->mode_in_use, flags);
+	if (daemon_mode)
+		return run_daemon();
 
-	dict_gui_create_main_window(dd);
+	if (batch_mode)
+		return run_batch(argc, argv);
 
-	g_signal_connect(dd->window, "delete-event", G_CALLBACK(main_quit), dd);
-	g_signal_connect(dd->close_button, "clicked", G_CALLBACK(close_button_clicked), dd);
-	/* file menu */
-	g_signal_connect(dd->close_menu_item, "activate", G_CALLBACK(close_button_clicked), dd);
-	g_signal_connect(dd->pref_menu_item, "activate", G_CALLBACK(pref_dialog_activated), dd);
+	flags = get_flags();
 
-	/* search text from command line options, if any */
-	if (NZV(search_text))
+	/* try to find an existing panel plugin and pop it up, unless there is a stand-alone
+	 * instance which gets the whole command line below */
+	if (! ignore_plugin && ! dict_find_stand_alone_app())
 	{
-		gtk_entry_set_text(GTK_ENTRY(dd->main_entry), search_text);
-		dict_search_word(dd, search_text);
+		/* connecting to the display takes a while, so we don't do it before we know that
+		 * we need it, unless we need it for reading the clipboard anyway */
+		if (use_clipboard)
+		{
+			gtk_init(&argc, &argv);
+			search_text = dict_get_clipboard_contents();
+		}
+		else
+		{
+			/* concatenate remaining command line arguments */
+			search_text = get_search_text(argc, argv);
+		}
+
+		if (dict_find_panel_plugin(flags, search_text))
+		{
+			if (verbose_mode)
+				g_message("Passed the search to the running instance after %.1f ms",
+					(g_get_monotonic_time() - start_time) / 1000.0);
+			g_free(search_text);
+			g_strfreev(app_argv);
+			exit(0);
+		}
+		g_free(search_text);
 	}
-	else
-		dict_gui_status_add(dd, _("Ready"));
 
-	g_free(search_text);
+	/* no plugin found, start the stand-alone app or pass the command line to the running
+	 * one, which has its settings loaded and its connections open already */
+	app = gtk_application_new(DICT_APP_ID, G_APPLICATION_HANDLES_COMMAND_LINE);
+	g_signal_connect(app, "command-line", G_CALLBACK(app_command_line), NULL);
 
-	dict_acquire_dbus_name(dd);
+	status = g_application_run(G_APPLICATION(app), g_strv_length(app_argv), app_argv);
 
-	gtk_widget_show_all(dd->window);
+	if (verbose_mode && g_application_get_is_remote(G_APPLICATION(app)))
+		g_message("Passed the search to the running instance after %.1f ms",
+			(g_get_monotonic_time() - start_time) / 1000.0);
 
-	gtk_main();
+	g_object_unref(app);
+	g_strfreev(app_argv);
 
-	return 0;
+	return status;
 }